@@ -0,0 +1,104 @@
+#ifndef BENCH_H
+#define BENCH_H
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// A deliberately tiny benchmarking harness. Every suite lives in its own
+/// `*_bench.cpp` file and is registered in `main.cpp`.
+namespace bench {
+
+using Clock = std::chrono::steady_clock;
+
+/// The settings given on the command line.
+struct Options {
+  /// How many megabytes of code `make_program()` generates for the lexer.
+  size_t corpus_mb = 16;
+
+  /// How many times sampled measurements are repeated.
+  size_t repetitions = 10;
+
+  /// Whether results are printed as one JSON document rather than as rows.
+  bool json = false;
+};
+
+/// Returns the settings of this run.
+Options &options();
+
+/// Prevents the optimizer from discarding the computation of `value`.
+template <typename T> void keep(const T &value) {
+  asm volatile("" : : "r"(&value) : "memory");
+}
+
+/// Calls `fn` `iterations` times and returns the mean wall time of one call in
+/// nanoseconds.
+template <typename F> double ns_per_call(size_t iterations, F &&fn) {
+  const auto start = Clock::now();
+  for (size_t i = 0; i < iterations; ++i)
+    fn(i);
+  const std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+  return elapsed.count() / static_cast<double>(iterations);
+}
+
+/// The wall time of one call, in nanoseconds, over several repetitions. With
+/// fewer than 100 repetitions, `p99` is the slowest one.
+struct Samples {
+  double min;
+  double median;
+  double p99;
+};
+
+/// Calls `fn` `repetitions` times, timing each call on its own.
+template <typename F> Samples sample(size_t repetitions, F &&fn) {
+  std::vector<double> times(std::max<size_t>(repetitions, 1));
+  for (size_t i = 0; i < times.size(); ++i) {
+    const auto start = Clock::now();
+    fn(i);
+    const std::chrono::duration<double, std::nano> elapsed =
+        Clock::now() - start;
+    times[i] = elapsed.count();
+  }
+  std::ranges::sort(times);
+  const size_t p99 = (times.size() * 99 + 99) / 100 - 1;
+  return {times.front(), times[times.size() / 2], times[p99]};
+}
+
+/// Prints one measurement as an aligned `suite/name  value unit` row.
+void report(std::string_view suite, std::string_view name, double value,
+            std::string_view unit);
+
+/// Prints sampled times, converted to milliseconds, as a `suite/name  min
+/// median p99 ms` row.
+void report(std::string_view suite, std::string_view name,
+            const Samples &samples);
+
+/// Builds roughly `bytes` of text made of lines between 0 and 80 characters.
+std::string make_lines(size_t bytes);
+
+/// Builds roughly `bytes` of Alta code made of small functions, with nested
+/// blocks, calls, literals of every kind and comments, always the same for
+/// the same size.
+std::string make_program(size_t bytes);
+
+/* -------------------------------------------------------------------------- */
+/* SUITES */
+/* -------------------------------------------------------------------------- */
+
+/// Line and column lookups on `Source`s of increasing size.
+void source_suite();
+
+/// Loading a synthetic tree of 10k small files.
+void loader_suite();
+
+/// Rendering many diagnostics spread over a large source.
+void diagnostic_suite();
+
+/// Lexer throughput on generated code with each SIMD level.
+void lexer_suite();
+
+}; // namespace bench
+
+#endif
@@ -0,0 +1,177 @@
+#include "bench.hpp"
+#include <array>
+#include <cstddef>
+#include <random>
+#include <string>
+#include <string_view>
+
+namespace bench {
+
+namespace {
+
+/// Generates Alta code from a fixed seed. Names, literals and operators are
+/// drawn with frequencies loosely modelled on real code: short names and
+/// small integers are common, and most statements are assignments.
+class Generator {
+  static constexpr std::array<std::string_view, 16> NAMES = {
+      "i",     "count",      "total", "items", "index",  "x",
+      "limit", "value",      "node",  "left",  "result", "remaining_bytes",
+      "n",     "is_visible", "buf",   "offset"};
+  static constexpr std::array<std::string_view, 14> OPERATORS = {
+      "+", "-", "*", "/", "%", "**", "//", "==", "!=", "<", "<=", ">=", "&&",
+      "||"};
+  static constexpr std::array<std::string_view, 6> ASSIGNMENTS = {
+      "=", "=", "=", "+=", "-=", "*="};
+  static constexpr std::array<std::string_view, 6> WORDS = {
+      "invalid", "input", "value out of range", "done", "%d items", "\\n"};
+
+  std::mt19937 rng{7};
+  std::string &text;
+
+  size_t pick(size_t n) {
+    return std::uniform_int_distribution<size_t>(0, n - 1)(rng);
+  }
+
+  void indent(size_t depth) { text.append(4 * depth, ' '); }
+
+  void name() {
+    text += NAMES[pick(NAMES.size())];
+    if (pick(4) == 0)
+      text += "_" + std::to_string(pick(10));
+  }
+
+  void number() {
+    if (pick(4) == 0)
+      text += std::to_string(pick(1000)) + "." + std::to_string(pick(100));
+    else if (pick(3) == 0)
+      text += std::to_string(pick(100000));
+    else
+      text += std::to_string(pick(10));
+  }
+
+  void operand() {
+    switch (pick(8)) {
+    case 0:
+    case 1:
+      number();
+      break;
+    case 2:
+      text += "\"" + std::string(WORDS[pick(WORDS.size())]) + "\"";
+      break;
+    case 3:
+      name();
+      text += "(";
+      name();
+      text += ")";
+      break;
+    default:
+      name();
+      break;
+    }
+  }
+
+  void expression() {
+    operand();
+    for (size_t terms = pick(4); terms > 0; --terms) {
+      text += " ";
+      text += OPERATORS[pick(OPERATORS.size())];
+      text += " ";
+      if (pick(6) == 0) {
+        text += "(";
+        expression();
+        text += ")";
+      } else {
+        operand();
+      }
+    }
+  }
+
+  void block(size_t depth) {
+    for (size_t statements = 2 + pick(6); statements > 0; --statements)
+      statement(depth);
+  }
+
+  void statement(size_t depth) {
+    indent(depth);
+    const bool nested = depth < 4;
+    switch (pick(10)) {
+    case 0:
+      if (nested) {
+        text += "if ";
+        expression();
+        text += " {\n";
+        block(depth + 1);
+        indent(depth);
+        text += "} else {\n";
+        block(depth + 1);
+        indent(depth);
+        text += "}\n";
+        break;
+      }
+      [[fallthrough]];
+    case 1:
+      if (nested) {
+        text += "for ";
+        name();
+        text += " < ";
+        expression();
+        text += " {\n";
+        block(depth + 1);
+        indent(depth + 1);
+        text += pick(2) == 0 ? "continue\n" : "break\n";
+        indent(depth);
+        text += "}\n";
+        break;
+      }
+      [[fallthrough]];
+    case 2:
+      text += "# ";
+      name();
+      text += " must stay below the limit\n";
+      break;
+    case 3:
+      name();
+      text += pick(2) == 0 ? "++\n" : "--\n";
+      break;
+    default:
+      name();
+      text += " ";
+      text += ASSIGNMENTS[pick(ASSIGNMENTS.size())];
+      text += " ";
+      expression();
+      text += "\n";
+      break;
+    }
+  }
+
+public:
+  explicit Generator(std::string &text) : text(text) {}
+
+  void function() {
+    if (pick(3) == 0)
+      text += "/* Computes the " + std::string(NAMES[pick(NAMES.size())]) +
+              " of a node. */\n";
+    text += "function ";
+    name();
+    text += "_" + std::to_string(pick(100)) + "(";
+    name();
+    text += ", ";
+    name();
+    text += ") {\n";
+    block(1);
+    text += "}\n\n";
+  }
+};
+
+}; // namespace
+
+std::string make_program(size_t bytes) {
+  std::string text;
+  text.reserve(bytes + 4096);
+  Generator generator(text);
+  while (text.size() < bytes)
+    generator.function();
+  return text;
+}
+
+}; // namespace bench
@@ -0,0 +1,39 @@
+#include "bench.hpp"
+#include "common/diagnostic.hpp"
+#include "common/span.hpp"
+#include <cstddef>
+#include <fstream>
+#include <random>
+#include <string>
+
+namespace bench {
+
+void diagnostic_suite() {
+  const Source src(make_lines(5 * 1024 * 1024));
+
+  for (const size_t count : {1000, 20000}) {
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<size_t> pick(0, src.size - 1);
+    DiagCollect diagnostics;
+    for (size_t i = 0; i < count; ++i) {
+      const Span span(src, pick(rng), 1);
+      diagnostics.push(Diagnostic(Diagnostic::Issue::InvalidCharacter, span,
+                                  Diagnostic::Arg(span)));
+    }
+
+    std::ofstream sink("/dev/null");
+    const std::string label = std::to_string(count) + " diagnostics";
+
+    const auto individual = ns_per_call(5, [&](size_t) {
+      for (const auto &diag : diagnostics)
+        sink << diag << std::endl;
+    });
+    report("diag", "individual " + label, individual / 1e6, "ms");
+
+    const auto batched =
+        ns_per_call(5, [&](size_t) { diagnostics.print_all(sink); });
+    report("diag", "batched " + label, batched / 1e6, "ms");
+  }
+}
+
+}; // namespace bench
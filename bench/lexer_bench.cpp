@@ -0,0 +1,176 @@
+#include "bench.hpp"
+#include "common/diagnostic.hpp"
+#include "common/simd.hpp"
+#include "common/span.hpp"
+#include "common/thread_pool.hpp"
+#include "lexer/lexer.hpp"
+#include "lexer/token.hpp"
+#include "lexer/token_ring.hpp"
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <cstddef>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+
+namespace bench {
+
+void lexer_suite() {
+  const Source src(make_program(options().corpus_mb * 1000 * 1000));
+  const double megabytes = static_cast<double>(src.size) / 1e6;
+
+  // Embedded data blobs, which are almost entirely string literal bodies
+  std::string blob_text;
+  while (blob_text.size() < 16 * 1024 * 1024)
+    blob_text += "data = \"" + std::string(4096, 'Q') + "\"\n";
+  const Source blobs(std::move(blob_text));
+
+  // A heavily commented generated file, mostly line and block comments
+  std::string commented_text;
+  while (commented_text.size() < 16 * 1024 * 1024)
+    commented_text += "/* " + std::string(2048, 'C') + " */\nx = 1 # " +
+                      std::string(200, 'L') + "\n";
+  const Source commented(std::move(commented_text));
+
+  constexpr std::pair<simd::Level, std::string_view> LEVELS[] = {
+      {simd::Level::Scalar, "scalar"},
+      {simd::Level::SSE2, "sse2"},
+      {simd::Level::AVX2, "avx2"},
+  };
+  const auto supported = simd::active_level();
+  for (const auto &[level, name] : LEVELS) {
+    if (level > supported)
+      continue;
+    simd::set_level(level);
+
+    // Throughput is given for the median run
+    size_t count = 0;
+    const auto samples = sample(options().repetitions, [&](size_t) {
+      DiagCollect diagnostics;
+      TokenCollect tokens(src);
+      Lexer lexer(src, tokens, diagnostics);
+      lexer.lex();
+      count = tokens.size();
+    });
+    const double seconds = samples.median / 1e9;
+    report("lexer", std::string(name) + " lex()", samples);
+    report("lexer", std::string(name) + " throughput", megabytes / seconds,
+           "MB/s");
+    report("lexer", std::string(name) + " tokens",
+           static_cast<double>(count) / seconds / 1e6, "Mtok/s");
+
+    const auto blob_ns = ns_per_call(5, [&](size_t) {
+      DiagCollect diagnostics;
+      TokenCollect tokens(blobs);
+      Lexer lexer(blobs, tokens, diagnostics);
+      lexer.lex();
+    });
+    report("lexer", std::string(name) + " string throughput",
+           static_cast<double>(blobs.size) / 1e6 / (blob_ns / 1e9), "MB/s");
+
+    const auto comment_ns = ns_per_call(5, [&](size_t) {
+      DiagCollect diagnostics;
+      TokenCollect tokens(commented);
+      Lexer lexer(commented, tokens, diagnostics);
+      lexer.lex();
+    });
+    report("lexer", std::string(name) + " comment throughput",
+           static_cast<double>(commented.size) / 1e6 / (comment_ns / 1e9),
+           "MB/s");
+  }
+
+  // The speed comments are skipped at should approach that of copying
+  std::string copy(commented.size, '\0');
+  const auto copy_ns = ns_per_call(5, [&](size_t) {
+    std::memcpy(copy.data(), commented.content.data(), commented.size);
+    keep(copy);
+  });
+  report("lexer", "memcpy throughput",
+         static_cast<double>(commented.size) / 1e6 / (copy_ns / 1e9), "MB/s");
+  simd::set_level(supported);
+
+  // Decoding the literals of a data table, against converting each lexeme
+  // through a temporary string like the parser used to
+  std::string table_text;
+  std::mt19937 rng(11);
+  std::uniform_int_distribution<int32_t> integer(0, 2000000000);
+  std::uniform_real_distribution<double> decimal(0, 1e6);
+  while (table_text.size() < 4 * 1024 * 1024)
+    table_text += std::to_string(integer(rng)) + ", " +
+                  std::to_string(decimal(rng)) + ",\n";
+  const Source table(std::move(table_text));
+  DiagCollect table_diagnostics;
+  TokenCollect table_tokens(table);
+  Lexer(table, table_tokens, table_diagnostics).lex();
+
+  size_t literals = 0;
+  for (const auto token : table_tokens)
+    literals += token.kind == Token::Kind::Integer ||
+                token.kind == Token::Kind::Decimal;
+  const auto decode = [&](auto integer_value, auto decimal_value) {
+    return ns_per_call(5, [&](size_t) {
+      double sum = 0;
+      for (const auto token : table_tokens) {
+        if (token.kind == Token::Kind::Integer)
+          sum += integer_value(token);
+        else if (token.kind == Token::Kind::Decimal)
+          sum += decimal_value(token);
+      }
+      keep(sum);
+    });
+  };
+  const auto decoded_ns =
+      decode([](const Token &token) { return token.integer(); },
+             [&](const Token &token) { return *decode_decimal(table, token); });
+  const auto converted_ns = decode(
+      [&](const Token &token) {
+        return std::stoi(std::string(token.span.lexeme(table)));
+      },
+      [&](const Token &token) {
+        return std::stod(std::string(token.span.lexeme(table)));
+      });
+  report("lexer", "literal decoding",
+         static_cast<double>(literals) / (decoded_ns / 1e9) / 1e6, "Mlit/s");
+  report("lexer", "literal decoding (stoi/stod)",
+         static_cast<double>(literals) / (converted_ns / 1e9) / 1e6, "Mlit/s");
+
+  // Pipelined lexing, where the first token is available long before the
+  // whole source has been lexed
+  std::chrono::duration<double, std::micro> first_token{};
+  const auto pipelined = ns_per_call(5, [&](size_t) {
+    DiagCollect diagnostics;
+    TokenRing ring;
+    const auto start = Clock::now();
+    std::jthread lexing([&] {
+      TokenCollect batch(src);
+      Lexer lexer(src, batch, diagnostics);
+      lexer.lex(ring);
+    });
+    keep(ring.at(0));
+    first_token += Clock::now() - start;
+    ring.drain();
+  });
+  report("lexer", "pipelined throughput", megabytes / (pipelined / 1e9),
+         "MB/s");
+  report("lexer", "pipelined first token", first_token.count() / 5, "us");
+
+  // Parallel lexing, which should scale with the threads of the pool
+  for (unsigned threads = 2; threads <= std::thread::hardware_concurrency();
+       threads *= 2) {
+    ThreadPool pool(threads);
+    const auto ns = ns_per_call(5, [&](size_t) {
+      DiagCollect diagnostics;
+      TokenCollect tokens(src);
+      Lexer lexer(src, tokens, diagnostics);
+      lexer.lex(pool);
+    });
+    report("lexer",
+           "parallel throughput (" + std::to_string(threads) + " threads)",
+           megabytes / (ns / 1e9), "MB/s");
+  }
+}
+
+}; // namespace bench
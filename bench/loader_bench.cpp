@@ -0,0 +1,81 @@
+#include "bench.hpp"
+#include "common/source_loader.hpp"
+#include "common/span.hpp"
+#include <atomic>
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+/// Writes a tree of `count` small files, 100 per directory, and returns their
+/// paths.
+std::vector<std::string> make_tree(const std::filesystem::path &root,
+                                   size_t count) {
+  std::vector<std::string> paths;
+  paths.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    const auto dir = root / ("module" + std::to_string(i / 100));
+    if (i % 100 == 0)
+      std::filesystem::create_directories(dir);
+
+    const auto path = (dir / ("unit" + std::to_string(i) + ".alta")).string();
+    std::ofstream file(path, std::ios::binary);
+    for (size_t line = 0; line < 20 + i % 40; ++line)
+      file << "value" << line << " := function(a, b) a * " << i << " + b\n";
+    paths.push_back(path);
+  }
+  return paths;
+}
+
+void loader_suite() {
+  constexpr size_t FILES = 10000;
+  const auto root =
+      std::filesystem::temp_directory_path() / "alta_bench_loader";
+  std::filesystem::remove_all(root);
+  const auto paths = make_tree(root, FILES);
+
+  // Each measurement loads the whole tree once; the files are hot in the page
+  // cache after the first run, so this measures syscall overhead.
+  const auto sequential = ns_per_call(5, [&](size_t) {
+    size_t bytes = 0;
+    for (const auto &path : paths)
+      bytes += Source::map(path).value()->size;
+    keep(bytes);
+  });
+  report("loader", "sequential map", sequential / 1e6, "ms/10k files");
+
+  for (const auto backend :
+       {SourceLoader::Backend::ThreadPool, SourceLoader::Backend::IoUring}) {
+    const SourceLoader loader(backend);
+    if (loader.get_backend() != backend)
+      continue;
+
+    std::atomic<size_t> first_ns = 0;
+    const auto batched = ns_per_call(5, [&](size_t) {
+      std::atomic<size_t> bytes = 0;
+      const auto start = Clock::now();
+      std::atomic<bool> first = true;
+      loader.load(paths, [&](size_t, SourceLoader::Result result) {
+        if (first.exchange(false)) {
+          first_ns += static_cast<size_t>(
+              std::chrono::nanoseconds(Clock::now() - start).count());
+        }
+        bytes += result.value()->size;
+      });
+      keep(bytes.load());
+    });
+
+    const std::string name =
+        backend == SourceLoader::Backend::IoUring ? "io_uring" : "thread pool";
+    report("loader", name, batched / 1e6, "ms/10k files");
+    report("loader", name + " first source",
+           static_cast<double>(first_ns.load()) / 5 / 1e3, "us");
+  }
+
+  std::filesystem::remove_all(root);
+}
+
+}; // namespace bench
@@ -0,0 +1,159 @@
+#include "bench.hpp"
+#include <charconv>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+namespace bench {
+
+namespace {
+
+/// One measurement, kept until the end of the run when printing JSON.
+struct Row {
+  std::string suite;
+  std::string name;
+  std::string unit;
+  double value;
+  std::optional<Samples> samples;
+};
+
+std::vector<Row> rows;
+
+/// Prints `text` as a JSON string. Names are plain ASCII, so only quotes and
+/// backslashes need escaping.
+void print_json_string(std::string_view text) {
+  std::putchar('"');
+  for (const char ch : text) {
+    if (ch == '"' || ch == '\\')
+      std::putchar('\\');
+    std::putchar(ch);
+  }
+  std::putchar('"');
+}
+
+void print_json() {
+  std::printf("{\n  \"corpus_mb\": %zu,\n  \"repetitions\": %zu,\n"
+              "  \"results\": [",
+              options().corpus_mb, options().repetitions);
+  for (size_t i = 0; i < rows.size(); ++i) {
+    const auto &row = rows[i];
+    std::printf(i == 0 ? "\n    {\"suite\": " : ",\n    {\"suite\": ");
+    print_json_string(row.suite);
+    std::printf(", \"name\": ");
+    print_json_string(row.name);
+    std::printf(", \"unit\": ");
+    print_json_string(row.unit);
+    if (row.samples.has_value())
+      std::printf(", \"min\": %.4f, \"median\": %.4f, \"p99\": %.4f}",
+                  row.samples->min, row.samples->median, row.samples->p99);
+    else
+      std::printf(", \"value\": %.4f}", row.value);
+  }
+  std::printf("\n  ]\n}\n");
+}
+
+}; // namespace
+
+Options &options() {
+  static Options settings;
+  return settings;
+}
+
+void report(std::string_view suite, std::string_view name, double value,
+            std::string_view unit) {
+  if (options().json) {
+    rows.push_back({std::string(suite), std::string(name), std::string(unit),
+                    value, std::nullopt});
+    return;
+  }
+  std::printf("%-10.*s %-32.*s %12.2f %.*s\n", static_cast<int>(suite.size()),
+              suite.data(), static_cast<int>(name.size()), name.data(), value,
+              static_cast<int>(unit.size()), unit.data());
+}
+
+void report(std::string_view suite, std::string_view name,
+            const Samples &samples) {
+  const Samples ms = {samples.min / 1e6, samples.median / 1e6,
+                      samples.p99 / 1e6};
+  if (options().json) {
+    rows.push_back(
+        {std::string(suite), std::string(name), "ms", ms.median, ms});
+    return;
+  }
+  std::printf("%-10.*s %-32.*s %12.2f %.2f/%.2f ms (min/p99)\n",
+              static_cast<int>(suite.size()), suite.data(),
+              static_cast<int>(name.size()), name.data(), ms.median, ms.min,
+              ms.p99);
+}
+
+}; // namespace bench
+
+struct Suite {
+  std::string_view name;
+  void (*run)();
+};
+
+constexpr Suite SUITES[] = {
+    {"source", bench::source_suite},
+    {"loader", bench::loader_suite},
+    {"diag", bench::diagnostic_suite},
+    {"lexer", bench::lexer_suite},
+};
+
+/// Parses the value of a `--flag=N` argument into `out`, if `arg` is `flag`.
+bool parse_size_flag(std::string_view arg, std::string_view flag,
+                     size_t &out) {
+  if (!arg.starts_with(flag))
+    return false;
+  const auto value = arg.substr(flag.size());
+  const auto [end, ec] =
+      std::from_chars(value.data(), value.data() + value.size(), out);
+  if (ec != std::errc() || end != value.data() + value.size()) {
+    std::cerr << "invalid value for " << flag << " '" << value << "'\n";
+    std::exit(1);
+  }
+  return true;
+}
+
+/// Runs every suite, or only the ones named on the command line.
+///
+///   --json             prints the results as one JSON document
+///   --corpus-mb=N      lexes N megabytes of generated code (default 16)
+///   --repetitions=N    repeats sampled measurements N times (default 10)
+///   --emit-corpus      prints the generated code instead of running suites
+int main(int argc, char **argv) {
+  auto &options = bench::options();
+  std::vector<std::string_view> selected;
+  bool emit_corpus = false;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    if (arg == "--json")
+      options.json = true;
+    else if (arg == "--emit-corpus")
+      emit_corpus = true;
+    else if (!parse_size_flag(arg, "--corpus-mb=", options.corpus_mb) &&
+             !parse_size_flag(arg, "--repetitions=", options.repetitions))
+      selected.push_back(arg);
+  }
+
+  if (emit_corpus) {
+    std::cout << bench::make_program(options.corpus_mb * 1000 * 1000);
+    return 0;
+  }
+
+  for (const auto &suite : SUITES) {
+    bool run = selected.empty();
+    for (const auto name : selected)
+      run |= suite.name == name;
+    if (run)
+      suite.run();
+  }
+  if (options.json)
+    bench::print_json();
+  return 0;
+}
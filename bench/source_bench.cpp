@@ -0,0 +1,112 @@
+#include "bench.hpp"
+#include "common/simd.hpp"
+#include "common/span.hpp"
+#include <cstddef>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <utility>
+#include <string>
+#include <vector>
+
+namespace bench {
+
+std::string make_lines(size_t bytes) {
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<size_t> width(0, 80);
+
+  std::string text;
+  text.reserve(bytes + 81);
+  while (text.size() < bytes) {
+    text.append(width(rng), 'x');
+    text.push_back('\n');
+  }
+  return text;
+}
+
+void source_suite() {
+  constexpr size_t QUERIES = 200000;
+
+  for (const size_t kb : {64, 1024, 5 * 1024, 32 * 1024}) {
+    const Source src(make_lines(kb * 1024));
+    const std::string label = std::to_string(kb) + "KiB";
+
+    // Indexing cost is paid once per source
+    const auto build = ns_per_call(4, [&](size_t) {
+      const Source copy{std::string(src.content)};
+      keep(copy.line_starts.size());
+    });
+    report("source", "index " + label, build / 1e6, "ms");
+
+    // Random offsets so no query benefits from the previous one
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<size_t> pick(0, src.size - 1);
+    std::vector<size_t> offsets(QUERIES);
+    for (auto &offset : offsets)
+      offset = pick(rng);
+
+    const auto lookup = ns_per_call(QUERIES, [&](size_t i) {
+      const Span span(src, offsets[i], 1);
+      keep(span.line_number());
+      keep(span.column_number());
+    });
+    report("source", "line+column " + label, lookup, "ns/query");
+
+    const auto line_text = ns_per_call(QUERIES, [&](size_t i) {
+      keep(src.line(src.line_of(offsets[i])));
+    });
+    report("source", "line text " + label, line_text, "ns/query");
+  }
+
+  // UTF-8 validation over 5 MiB of ASCII, and of text where roughly one
+  // character in eight is a multi-byte sequence
+  std::string ascii_text = make_lines(5 * 1024 * 1024);
+  std::string utf8_text = ascii_text;
+  for (size_t i = 0; i + 3 < utf8_text.size(); i += 24)
+    utf8_text.replace(i, 3, "\xE2\x82\xAC");
+
+  for (const auto &[name, text] :
+       {std::pair{"ascii", &ascii_text}, std::pair{"utf-8", &utf8_text}}) {
+    const auto validate = ns_per_call(20, [&](size_t) {
+      keep(simd::check_utf8(text->data(), text->size()));
+    });
+    report("source", std::string("validate 5MiB ") + name, validate / 1e6,
+           "ms");
+
+    const Source src{std::string(*text)};
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<size_t> pick(0, src.size - 1);
+    const auto column = ns_per_call(QUERIES, [&](size_t) {
+      keep(src.column_of(pick(rng)));
+    });
+    report("source", std::string("column 5MiB ") + name, column, "ns/query");
+  }
+
+  // Time-to-content for a large file: mapping vs. reading it onto the heap
+  const auto path =
+      (std::filesystem::temp_directory_path() / "alta_bench_source.alta")
+          .string();
+  {
+    std::ofstream file(path, std::ios::binary);
+    file << make_lines(64 * 1024 * 1024);
+  }
+
+  const auto mapped = ns_per_call(8, [&](size_t) {
+    const auto src = Source::map(path);
+    keep(src.value()->size);
+  });
+  report("source", "map 64MiB", mapped / 1e6, "ms");
+
+  const auto copied = ns_per_call(8, [&](size_t) {
+    std::ifstream file(path, std::ios::binary);
+    const Source src(std::string(std::istreambuf_iterator<char>(file), {}),
+                     path);
+    keep(src.size);
+  });
+  report("source", "read+copy 64MiB", copied / 1e6, "ms");
+
+  std::filesystem::remove(path);
+}
+
+}; // namespace bench
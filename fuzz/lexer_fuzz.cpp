@@ -0,0 +1,284 @@
+#include "common/diagnostic.hpp"
+#include "common/simd.hpp"
+#include "common/span.hpp"
+#include "common/symbol_table.hpp"
+#include "common/thread_pool.hpp"
+#include "lexer/lexer.hpp"
+#include "lexer/stream_lexer.hpp"
+#include "lexer/token.hpp"
+#include "lexer/token_ring.hpp"
+#include "reference_lexer.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+/// A differential fuzzer for the lexer. Every input is lexed by the simple
+/// reference lexer in `reference_lexer.cpp`, which shares none of the real
+/// lexer's tables, and then by every way the tree has of lexing it: at each
+/// SIMD level, in parallel chunks, pipelined through a `TokenRing`, streamed in
+/// small chunks, keeping trivia, and re-lexed after an edit. The SIMD levels
+/// are also compared with the scalar one, so that a difference in a scanner is
+/// told apart from one in the rest of the lexer. Any difference in token
+/// kinds, spans or symbols, or in diagnostics, aborts with a description of
+/// the first one.
+///
+/// Builds as a libFuzzer target, or links with `replay.cpp` to run inputs
+/// from files without libFuzzer.
+
+namespace {
+
+/// Everything lexing produced, by position within the source, so that the
+/// output of different sources with the same content compares equal.
+struct Lexed {
+  std::vector<std::tuple<Token::Kind, uint64_t, uint32_t, Symbol>> tokens;
+  std::vector<std::tuple<Diagnostic::Issue, uint64_t, uint32_t>> diagnostics;
+  std::vector<std::pair<uint64_t, uint32_t>> trivia;
+
+  bool operator==(const Lexed &) const = default;
+};
+
+void collect_tokens(Lexed &lexed, const Source &src,
+                    const TokenCollect &tokens) {
+  for (size_t i = 0; i < tokens.size(); ++i) {
+    const auto token = tokens[i];
+    lexed.tokens.emplace_back(token.kind, token.span.offset - src.base,
+                              token.span.length, token.symbol);
+    if (tokens.keeps_trivia())
+      for (const auto &comment : tokens.trivia(i))
+        lexed.trivia.emplace_back(comment.offset - src.base, comment.length);
+  }
+}
+
+void collect_diagnostics(Lexed &lexed, const Source &src,
+                         const DiagCollect &diagnostics) {
+  for (const auto &diag : diagnostics)
+    lexed.diagnostics.emplace_back(diag.issue, diag.span.offset - src.base,
+                                   diag.span.length);
+}
+
+/// Lexes `src` with `lex`, which is given fresh collections to fill.
+Lexed lex_with(const Source &src, size_t error_limit, bool keep_trivia,
+               const std::function<void(Lexer &, TokenCollect &,
+                                        DiagCollect &)> &lex) {
+  DiagCollect diagnostics(error_limit);
+  TokenCollect tokens(src, keep_trivia);
+  Lexer lexer(src, tokens, diagnostics);
+  lex(lexer, tokens, diagnostics);
+
+  Lexed lexed;
+  collect_tokens(lexed, src, tokens);
+  collect_diagnostics(lexed, src, diagnostics);
+  return lexed;
+}
+
+Lexed lex_reference(const Source &src, size_t error_limit,
+                    bool keep_trivia = false) {
+  DiagCollect diagnostics(error_limit);
+  TokenCollect tokens(src, keep_trivia);
+  ::lex_reference(src, tokens, diagnostics);
+
+  Lexed lexed;
+  collect_tokens(lexed, src, tokens);
+  collect_diagnostics(lexed, src, diagnostics);
+  return lexed;
+}
+
+Lexed lex_scalar(const Source &src) {
+  simd::set_level(simd::Level::Scalar);
+  auto lexed = lex_with(src, 0, false,
+                        [](Lexer &lexer, auto &, auto &) { lexer.lex(); });
+  simd::set_level(simd::Level::AVX2);
+  return lexed;
+}
+
+/// Reports the first difference between `expected` and `actual`, and aborts.
+void check(std::string_view variant, std::string_view text,
+           const Lexed &expected, const Lexed &actual,
+           std::string_view against = "the reference") {
+  if (expected == actual)
+    return;
+
+  std::fprintf(stderr, "%.*s lexing differs from %.*s on ",
+               static_cast<int>(variant.size()), variant.data(),
+               static_cast<int>(against.size()), against.data());
+  std::fprintf(stderr, "%zu bytes of input\n", text.size());
+  const auto report = [](const char *what, const auto &want, const auto &got) {
+    const auto [w, g] = std::ranges::mismatch(want, got);
+    if (w == want.end() && g == got.end())
+      return;
+    std::fprintf(stderr, "  %s differ at index %zu of %zu/%zu\n", what,
+                 static_cast<size_t>(w - want.begin()), want.size(),
+                 got.size());
+  };
+  report("tokens", expected.tokens, actual.tokens);
+  report("diagnostics", expected.diagnostics, actual.diagnostics);
+  report("trivia", expected.trivia, actual.trivia);
+
+  // Short inputs are printed escaped, to be pasted into a test
+  if (text.size() <= 4096) {
+    std::fprintf(stderr, "  input: \"");
+    for (const char ch : text) {
+      const auto byte = static_cast<unsigned char>(ch);
+      if (byte == '"' || byte == '\\')
+        std::fprintf(stderr, "\\%c", ch);
+      else if (byte >= ' ' && byte < 0x7f)
+        std::fputc(ch, stderr);
+      else
+        std::fprintf(stderr, "\\x%02X\"\"", byte);
+    }
+    std::fprintf(stderr, "\"\n");
+  }
+  std::abort();
+}
+
+/// Derives the parameters of the variants from the input, so that every input
+/// always runs the same way.
+struct Knobs {
+  size_t chunk;
+  size_t error_limit;
+  SourceEdit edit;
+
+  explicit Knobs(std::string_view text) {
+    const auto seed = std::hash<std::string_view>{}(text);
+    chunk = 1 + seed % 61;
+    error_limit = (seed >> 8) % 4;
+
+    const size_t offset = (seed >> 16) % (text.size() + 1);
+    const size_t from = (seed >> 32) % (text.size() + 1);
+    edit = {
+        .offset = offset,
+        .removed = std::min<size_t>((seed >> 24) % 8, text.size() - offset),
+        .inserted = text.substr(from, (seed >> 40) % 8),
+    };
+  }
+};
+
+void check_simd_levels(const Source &src, std::string_view text,
+                       const Lexed &expected) {
+  const auto scalar = lex_scalar(src);
+  check("scalar", text, expected, scalar);
+
+  // Levels the CPU lacks fall back to the widest one it has
+  constexpr std::pair<simd::Level, std::string_view> LEVELS[] = {
+      {simd::Level::SSE2, "sse2"},
+      {simd::Level::AVX2, "avx2"},
+  };
+  for (const auto &[level, name] : LEVELS) {
+    simd::set_level(level);
+    check(name, text, scalar,
+          lex_with(src, 0, false,
+                   [](Lexer &lexer, auto &, auto &) { lexer.lex(); }),
+          "scalar lexing");
+  }
+}
+
+void check_parallel(const Source &src, std::string_view text,
+                    const Knobs &knobs) {
+  static ThreadPool pool(2);
+  for (const size_t limit : {size_t(0), knobs.error_limit}) {
+    check("parallel", text, lex_reference(src, limit),
+          lex_with(src, limit, false, [&](Lexer &lexer, auto &, auto &) {
+            lexer.lex(pool, knobs.chunk);
+          }));
+  }
+}
+
+void check_pipelined(const Source &src, std::string_view text,
+                     const Lexed &expected) {
+  DiagCollect diagnostics;
+  TokenRing ring(2);
+  std::jthread lexing([&] {
+    TokenCollect batch(src);
+    Lexer(src, batch, diagnostics).lex(ring);
+  });
+
+  // The ring hands out tokens rather than a collection, so they are pushed
+  // into one to be compared
+  TokenCollect tokens(src);
+  for (size_t i = 0;; ++i) {
+    const auto token = ring.at(i);
+    tokens.push(token);
+    ring.release(i);
+    if (token.kind == Token::Kind::Eof)
+      break;
+  }
+  lexing.join();
+
+  Lexed lexed;
+  collect_tokens(lexed, src, tokens);
+  collect_diagnostics(lexed, src, diagnostics);
+  check("pipelined", text, expected, lexed);
+}
+
+void check_streamed(std::string_view text, const Knobs &knobs,
+                    const Lexed &expected) {
+  Lexed lexed;
+  StreamLexer lexer(
+      "<fuzz>",
+      [&](const Token &token, const StreamPosition &at) {
+        lexed.tokens.emplace_back(token.kind, at.offset, token.span.length,
+                                  token.symbol);
+      },
+      [&](const Diagnostic &diag, const StreamPosition &at) {
+        lexed.diagnostics.emplace_back(diag.issue, at.offset,
+                                       diag.span.length);
+      });
+  for (size_t i = 0; i < text.size(); i += knobs.chunk)
+    lexer.feed(text.substr(i, knobs.chunk));
+  lexer.finish();
+  check("streamed", text, expected, lexed);
+}
+
+void check_trivia(const Source &src, std::string_view text,
+                  const Lexed &expected) {
+  // Keeping comments mustn't change the tokens or diagnostics
+  auto lexed = lex_reference(src, 0, true);
+  lexed.trivia.clear();
+  check("trivia-keeping", text, expected, lexed);
+}
+
+void check_relexed(const Source &src, std::string_view text,
+                   const Knobs &knobs) {
+  std::string edited_text(text);
+  edited_text.replace(knobs.edit.offset, knobs.edit.removed,
+                      knobs.edit.inserted);
+  const Source edited(edited_text);
+
+  // Re-lexing reports only the diagnostics of what it lexed again, so only
+  // the tokens and their trivia are compared
+  DiagCollect ignored;
+  TokenCollect tokens(src, true);
+  Lexer(src, tokens, ignored).lex();
+  Lexer(edited, tokens, ignored).relex(knobs.edit);
+
+  Lexed lexed;
+  collect_tokens(lexed, edited, tokens);
+  auto expected = lex_reference(edited, 0, true);
+  expected.diagnostics.clear();
+  check("re-lexed", edited_text, expected, lexed);
+}
+
+}; // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  const std::string text(reinterpret_cast<const char *>(data), size);
+  const Source src(text);
+  const Knobs knobs(text);
+
+  const auto expected = lex_reference(src, 0);
+  check_simd_levels(src, text, expected);
+  check_parallel(src, text, knobs);
+  check_pipelined(src, text, expected);
+  check_streamed(text, knobs, expected);
+  check_trivia(src, text, expected);
+  check_relexed(src, text, knobs);
+  return 0;
+}
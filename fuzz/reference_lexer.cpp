@@ -0,0 +1,349 @@
+#include "reference_lexer.hpp"
+#include "common/diagnostic.hpp"
+#include "common/span.hpp"
+#include "common/symbol_table.hpp"
+#include "lexer/token.hpp"
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string_view>
+#include <system_error>
+
+/// A copy of the original, simple lexer, kept up to date with the language
+/// but deliberately not with the optimisations of the real one: every byte is
+/// looked at on its own, through the functions below, and the real lexer's
+/// lead table, keyword hash, operator DFA and SIMD scanners are never used.
+
+namespace {
+
+/* -------------------------------------------------------------------------- */
+/* NON-ASSOCIATED HELPERS */
+/* -------------------------------------------------------------------------- */
+
+Token::Kind keyword_or_identifier(const std::string_view &sv) {
+  using enum Token::Kind;
+
+  if (sv == "if")
+    return If;
+  if (sv == "else")
+    return Else;
+  if (sv == "function")
+    return Function;
+  if (sv == "for")
+    return For;
+  if (sv == "break")
+    return Break;
+  if (sv == "continue")
+    return Continue;
+
+  // default to identifier
+  return Identifier;
+}
+
+bool is_digit(char ch) { return ch >= '0' && ch <= '9'; }
+bool is_ident_start(char ch) {
+  return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_' ||
+         static_cast<unsigned char>(ch) >= 0x80;
+}
+bool is_ident_cont(char ch) { return is_ident_start(ch) || is_digit(ch); }
+bool is_whitespace(char ch) {
+  return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\v' || ch == '\b';
+}
+bool is_escape(char ch) {
+  return ch == 'n' || ch == 't' || ch == 'r' || ch == '0' || ch == '\\' ||
+         ch == '"' || ch == '\'';
+}
+
+/* -------------------------------------------------------------------------- */
+/* REFERENCE LEXER */
+/* -------------------------------------------------------------------------- */
+
+struct ReferenceLexer {
+  const Source &source;
+  TokenCollect &tokens;
+  DiagCollect &diagnostics;
+  size_t cursor = 0;
+
+  /// Returns the byte `k` past the cursor, or `'\0'` past the end.
+  [[nodiscard]] char peek(size_t k = 0) const {
+    return cursor + k < source.size ? source.content[cursor + k] : '\0';
+  }
+
+  [[nodiscard]] Span span_from(size_t start) const {
+    return Span(source, start, cursor - start + 1);
+  }
+
+  void report(Diagnostic::Issue issue, const Span &span) {
+    diagnostics.push(Diagnostic(issue, span, Diagnostic::Arg(span)));
+  }
+
+  void skip_line_comment() {
+    const auto start = cursor;
+    while (cursor < source.size && peek() != '\n')
+      ++cursor;
+    tokens.push_trivia(Span(source, start, cursor - start));
+  }
+
+  void skip_block_comment() {
+    const auto start = cursor;
+    size_t depth = 1;
+    cursor += 2;
+    while (depth > 0) {
+      if (peek() == '*' && peek(1) == '/') {
+        --depth;
+        cursor += 2;
+      } else if (peek() == '/' && peek(1) == '*') {
+        ++depth;
+        cursor += 2;
+      } else if (cursor < source.size) {
+        ++cursor;
+      } else {
+        diagnostics.push(Diagnostic(Diagnostic::Issue::UnterminatedComment,
+                                    Span(source, start, cursor - start)));
+        break;
+      }
+    }
+    tokens.push_trivia(Span(source, start, cursor - start));
+  }
+
+  Token lex_identifier() {
+    const auto start = cursor;
+    while (is_ident_cont(peek(1)))
+      ++cursor;
+
+    const auto span = span_from(start);
+    const auto sv = source.content.substr(start, span.length);
+    const auto kind = keyword_or_identifier(sv);
+    if (kind != Token::Kind::Identifier)
+      return Token(kind, span);
+    return Token(kind, span, SymbolTable::global().intern(sv));
+  }
+
+  Token lex_number() {
+    const auto start = cursor;
+    while (is_digit(peek(1)))
+      ++cursor;
+
+    // A decimal is too large only if it has a nonzero integer part and still
+    // doesn't fit, a tiny one rounding to zero instead
+    if (peek(1) == '.' && is_digit(peek(2))) {
+      const auto dot = cursor + 1;
+      cursor += 2;
+      while (is_digit(peek(1)))
+        ++cursor;
+      const auto span = span_from(start);
+      const auto lexeme = source.content.substr(start, span.length);
+      double value = 0;
+      const auto result = std::from_chars(
+          lexeme.data(), lexeme.data() + lexeme.size(), value);
+      const auto integer = source.content.substr(start, dot - start);
+      if (result.ec == std::errc::result_out_of_range &&
+          integer.find_first_not_of('0') != std::string_view::npos) {
+        diagnostics.push(Diagnostic(Diagnostic::Issue::LiteralOverflow, span,
+                                    Diagnostic::Arg(span),
+                                    Diagnostic::Arg("decimal")));
+      }
+      return Token(Token::Kind::Decimal, span);
+    }
+
+    const auto span = span_from(start);
+    int32_t value = 0;
+    bool overflow = false;
+    for (size_t i = start; i <= cursor; ++i) {
+      const int32_t digit = source.content[i] - '0';
+      if (value > (INT32_MAX - digit) / 10)
+        overflow = true;
+      else
+        value = value * 10 + digit;
+    }
+    if (overflow) {
+      diagnostics.push(Diagnostic(Diagnostic::Issue::LiteralOverflow, span,
+                                  Diagnostic::Arg(span),
+                                  Diagnostic::Arg("32-bit integer")));
+      value = INT32_MAX;
+    }
+    return Token(Token::Kind::Integer, span, static_cast<Symbol>(value));
+  }
+
+  std::optional<Token> lex_string() {
+    const auto start = cursor;
+    bool valid = true;
+    while (true) {
+      ++cursor;
+      const auto ch = peek();
+      if (ch == '"')
+        break;
+
+      // An escape is checked and skipped, unless what it escapes ends the line
+      if (ch == '\\') {
+        valid = valid && is_escape(peek(1));
+        if (peek(1) != '\n' && cursor + 1 < source.size)
+          ++cursor;
+        continue;
+      }
+      if (ch != '\n' && cursor < source.size)
+        continue;
+
+      // A newline or the end of the source, which the main loop lexes next
+      const Span span(source, start, cursor - start);
+      diagnostics.push(
+          Diagnostic(Diagnostic::Issue::UnterminatedString, span));
+      --cursor;
+      return std::nullopt;
+    }
+
+    const auto span = span_from(start);
+    if (!valid) {
+      diagnostics.push(Diagnostic(Diagnostic::Issue::InvalidString, span));
+      return std::nullopt;
+    }
+    return Token(Token::Kind::String, span);
+  }
+
+  /// Returns the operator `ch` starts, trying the longer spellings first.
+  std::optional<Token> lex_operator(char ch) {
+    using enum Token::Kind;
+    const auto start = cursor;
+    const auto single = [&](Token::Kind kind) {
+      return Token(kind, Span(source, start, 1));
+    };
+    const auto longer = [&](size_t length, Token::Kind kind) {
+      cursor += length - 1;
+      return Token(kind, Span(source, start, length));
+    };
+    const auto peek1 = peek(1);
+    const auto peek2 = peek(2);
+
+    switch (ch) {
+    case '\n':
+      return single(Newline);
+    case '(':
+      return single(LParen);
+    case ')':
+      return single(RParen);
+    case '[':
+      return single(LBrac);
+    case ']':
+      return single(RBrac);
+    case '{':
+      return single(LCurl);
+    case '}':
+      return single(RCurl);
+    case '.':
+      return single(Dot);
+    case ',':
+      return single(Comma);
+    case ':':
+      return single(Colon);
+    case ';':
+      return single(Semicolon);
+    case '?':
+      return single(Question);
+    case '%':
+      return single(Percent);
+
+    case '+':
+      if (peek1 == '+')
+        return longer(2, PlusPlus);
+      if (peek1 == '=')
+        return longer(2, PlusEqual);
+      return single(Plus);
+    case '-':
+      if (peek1 == '-')
+        return longer(2, MinusMinus);
+      if (peek1 == '=')
+        return longer(2, MinusEqual);
+      return single(Minus);
+    case '*':
+      if (peek1 == '*' && peek2 == '=')
+        return longer(3, StarStarEqual);
+      if (peek1 == '*')
+        return longer(2, StarStar);
+      if (peek1 == '=')
+        return longer(2, StarEqual);
+      return single(Star);
+    case '/':
+      if (peek1 == '/' && peek2 == '=')
+        return longer(3, SlashSlashEqual);
+      if (peek1 == '/')
+        return longer(2, SlashSlash);
+      if (peek1 == '=')
+        return longer(2, SlashEqual);
+      return single(Slash);
+
+    case '<':
+      return peek1 == '=' ? longer(2, LessEqual) : single(Less);
+    case '>':
+      return peek1 == '=' ? longer(2, MoreEqual) : single(More);
+    case '!':
+      return peek1 == '=' ? longer(2, BangEqual) : single(Bang);
+    case '=':
+      return peek1 == '=' ? longer(2, EqualEqual) : single(Equal);
+    case '&':
+      return peek1 == '&' ? longer(2, AndAnd) : single(And);
+    case '|':
+      return peek1 == '|' ? longer(2, BarBar) : single(Bar);
+    }
+    return std::nullopt;
+  }
+
+  std::optional<Token> lex_once() {
+    while (true) {
+      while (is_whitespace(peek()))
+        ++cursor;
+      if (peek() == '#')
+        skip_line_comment();
+      else if (peek() == '/' && peek(1) == '*')
+        skip_block_comment();
+      else
+        break;
+    }
+    const auto start = cursor;
+    const auto ch = peek();
+
+    if (cursor >= source.size)
+      return Token(Token::Kind::Eof, Span(source, cursor, 1));
+    if (is_ident_start(ch))
+      return lex_identifier();
+    if (is_digit(ch))
+      return lex_number();
+    if (ch == '"')
+      return lex_string();
+    if (const auto token = lex_operator(ch))
+      return token;
+
+    // If nothing else matches it's an illegal character
+    report(Diagnostic::Issue::InvalidCharacter, span_from(start));
+    return std::nullopt;
+  }
+
+  void lex() {
+    if (source.invalid_utf8.has_value()) {
+      diagnostics.push(
+          Diagnostic(Diagnostic::Issue::InvalidEncoding,
+                     Span(source, source.invalid_utf8.value(), 1)));
+    }
+
+    // Stops at the end, or at the first error past the limit
+    bool bailed = diagnostics.limit_reached();
+    while (!bailed && cursor < source.size) {
+      const auto token = lex_once();
+      if (token.has_value() && token->kind == Token::Kind::Eof)
+        break;
+      if (token.has_value())
+        tokens.push(token.value());
+      else
+        bailed = diagnostics.limit_reached();
+      ++cursor;
+    }
+    tokens.push(Token(Token::Kind::Eof, Span(source, source.size, 1)));
+  }
+};
+
+}; // namespace
+
+void lex_reference(const Source &source, TokenCollect &tokens,
+                   DiagCollect &diagnostics) {
+  ReferenceLexer{source, tokens, diagnostics}.lex();
+}
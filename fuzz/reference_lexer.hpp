@@ -0,0 +1,14 @@
+#ifndef REFERENCE_LEXER_H
+#define REFERENCE_LEXER_H
+#include "common/diagnostic.hpp"
+#include "common/span.hpp"
+#include "lexer/token.hpp"
+
+/// Lexes `source` into `tokens` and `diagnostics` the way `Lexer::lex()` does,
+/// one character at a time with a plain `switch` and keyword comparisons. It
+/// shares none of the lexer's tables, scanners or state machines, so that the
+/// fuzzer can catch a bug in them rather than reproduce it on both sides.
+void lex_reference(const Source &source, TokenCollect &tokens,
+                   DiagCollect &diagnostics);
+
+#endif
@@ -0,0 +1,112 @@
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+namespace {
+
+void run(std::string_view input) {
+  LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t *>(input.data()),
+                         input.size());
+}
+
+/// Returns every file at `path`, which may be a file or a directory searched
+/// recursively, in sorted order so that runs are reproducible.
+std::vector<std::filesystem::path>
+inputs_at(const std::filesystem::path &path) {
+  if (!std::filesystem::is_directory(path))
+    return {path};
+
+  std::vector<std::filesystem::path> files;
+  for (const auto &entry :
+       std::filesystem::recursive_directory_iterator(path))
+    if (entry.is_regular_file())
+      files.push_back(entry.path());
+  std::ranges::sort(files);
+  return files;
+}
+
+/// Builds an input out of fragments that exercise the lexer's fast paths and
+/// the edges between them, plus the occasional random byte.
+std::string random_input(std::mt19937 &rng) {
+  static constexpr std::string_view FRAGMENTS[] = {
+      " ",  "\n",   "\t",      "x",      "name_1", "function", "if",
+      "0",  "12.5", "7.",      "+",      "++",     "+=",       "**=",
+      "//=", "/",   "*",       "&&",     "|",      "!=",       "(",
+      "}",  "\"",   "\\",      "\\n",    "\"s\"",  "#",        "/*",
+      "*/", "$",    "\xC3\xA9", "\xFF",   {"\0", 1},
+      "aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaa",
+      "                                        ",
+  };
+
+  std::string input;
+  for (size_t parts = rng() % 64; parts > 0; --parts) {
+    if (rng() % 16 == 0)
+      input.push_back(static_cast<char>(rng()));
+    else
+      input += FRAGMENTS[rng() % std::size(FRAGMENTS)];
+  }
+  return input;
+}
+
+}; // namespace
+
+/// Replays inputs through the differential lexer fuzzer without libFuzzer, so
+/// that crashes and corpora can be checked with any compiler and no network.
+///
+///   alta_fuzz_replay <file or directory>...   runs every input found
+///   alta_fuzz_replay --random=N [--seed=S]    runs N generated inputs
+///
+/// A difference between the lexers aborts, naming the input it was found on.
+int main(int argc, char **argv) {
+  size_t random = 0;
+  unsigned seed = 1;
+  std::vector<std::filesystem::path> paths;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    if (arg.starts_with("--random="))
+      random = std::stoul(std::string(arg.substr(9)));
+    else if (arg.starts_with("--seed="))
+      seed = static_cast<unsigned>(std::stoul(std::string(arg.substr(7))));
+    else
+      paths.emplace_back(arg);
+  }
+  if (paths.empty() && random == 0) {
+    std::cerr << "usage: alta_fuzz_replay <file or directory>...\n"
+              << "       alta_fuzz_replay --random=N [--seed=S]\n";
+    return 1;
+  }
+
+  size_t count = 0;
+  for (const auto &path : paths) {
+    for (const auto &file : inputs_at(path)) {
+      std::ifstream stream(file, std::ios::binary);
+      if (!stream) {
+        std::cerr << "cannot read '" << file.string() << "'\n";
+        return 1;
+      }
+      const std::string input(std::istreambuf_iterator<char>(stream), {});
+      std::cerr << "running " << file.string() << "\n";
+      run(input);
+      ++count;
+    }
+  }
+
+  std::mt19937 rng(seed);
+  for (size_t i = 0; i < random; ++i) {
+    run(random_input(rng));
+    ++count;
+  }
+
+  std::cerr << "ran " << count << " inputs without a difference\n";
+  return 0;
+}
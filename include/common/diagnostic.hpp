@@ -1,58 +1,167 @@
 #ifndef DIAGNOSTIC_H
 #define DIAGNOSTIC_H
 #include "common/span.hpp"
+#include <atomic>
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <type_traits>
 #include <vector>
 
 #define DIAGNOSTIC_ISSUES                                                      \
-  X(InvalidCharacter, "invalid character", Error)                              \
-  X(InvalidString, "invalid string", Error)                                    \
-  X(UnterminatedString, "unterminated string", Error)                          \
-  X(ExpectedExpression, "expected expression", Error)                          \
-  X(InternalError, "internal error", Error)
+  X(InvalidCharacter, "invalid character", Error, Lexer,                       \
+    "'{0}' is not allowed here.")                                              \
+  X(InvalidEncoding, "invalid UTF-8", Error, Lexer,                            \
+    "This file is not valid UTF-8.")                                           \
+  X(InvalidString, "invalid string", Error, Lexer,                             \
+    "This string literal is invalid.")                                         \
+  X(UnterminatedString, "unterminated string", Error, Lexer,                   \
+    "This string literal is never closed.")                                    \
+  X(UnterminatedComment, "unterminated comment", Error, Lexer,                 \
+    "This block comment is never closed.")                                     \
+  X(LiteralOverflow, "literal out of range", Error, Lexer,                     \
+    "'{0}' is too large for a {1}.")                                           \
+  X(ExpectedExpression, "expected expression", Error, Parser,                  \
+    "Expected an expression here.")                                            \
+  X(InternalError, "internal error", Error, Internal, "{0}")
 
 /// Used to represent some kind of compiler error that should be emitted to the
 /// user. Not all diagnostics are errors, some may be warnings or just info
 /// which is configured with the `level` member. `Diagnostics` also support
 /// stream insertion.
+///
+/// The help message comes from a static table generated by the
+/// `DIAGNOSTIC_ISSUES` X-macro, and the values it mentions are stored as
+/// compact arguments that are only formatted when the diagnostic is rendered,
+/// so creating and copying a diagnostic never allocates.
 struct Diagnostic {
   /// Represents the three different levels that a diagnostic can take on.
   /// `Error` is the only level that can abort compilation.
   enum class Level { Error, Warning, Info };
 
+  /// The compiler phase that reports an issue, in pipeline order. Breaks ties
+  /// between diagnostics at the same position when they are merged.
+  enum class Phase { Lexer, Parser, Internal };
+
   /// Refers to the specific problem this diagnostic is reporting about, defined
   /// by the `DIAGNOSTIC_ISSUES` X-macro.
   enum class Issue {
-#define X(name, repr, level) name,
+#define X(name, repr, level, phase, help) name,
     DIAGNOSTIC_ISSUES
 #undef X
   };
 
+  /// A value substituted for a `{0}` or `{1}` placeholder in the help message.
+  struct Arg {
+    enum class Kind : uint8_t { None, Lexeme, Text };
+
+    Kind kind;
+    union {
+      /// Rendered as the bytes it points to, with control characters escaped.
+      Span lexeme;
+      /// A string with static storage duration, rendered as is.
+      const char *text;
+    };
+
+    constexpr Arg() : kind(Kind::None), text(nullptr) {}
+    constexpr explicit Arg(Span lexeme) : kind(Kind::Lexeme), lexeme(lexeme) {}
+    constexpr explicit Arg(const char *text) : kind(Kind::Text), text(text) {}
+  };
+
   const Level level;
   const Issue issue;
   const Span span;
-  const std::string message;
+  const Arg args[2];
 
-  Diagnostic(Issue issue, const Span &span, std::string message);
+  Diagnostic(Issue issue, const Span &span, Arg first = Arg(),
+             Arg second = Arg());
+
+  /// Returns the phase that reports this diagnostic's issue.
+  [[nodiscard]] Phase phase() const;
+
+  /// Formats the issue's help message with this diagnostic's arguments.
+  [[nodiscard]] std::string message() const;
 };
 
-/// Basic `std::vector<Diagnostic>` wrapper that is used to collect errors.
-/// Basically just gives a short-hand way of moving the errors around the
-/// compiler. All the phases should take this collection by reference.
+static_assert(std::is_trivially_copyable_v<Diagnostic>);
+
+/// Collects the diagnostics reported by every phase of the compiler. All the
+/// phases should take this collection by reference.
+///
+/// Any number of threads may `push()` at once. Each thread appends to its own
+/// shard without taking a lock (only its very first push to a collector
+/// registers the shard), and reading the collection merges the shards ordered
+/// by source position and then phase, so the result doesn't depend on how the
+/// work was split between threads. Reading must not overlap with pushing.
+///
+/// Runs of adjacent diagnostics reporting the same issue are coalesced into
+/// one spanning the whole run, and diagnostics from a later phase that start
+/// inside (or right after) an error of an earlier phase are dropped as
+/// cascades of that error.
 class DiagCollect {
-  std::vector<Diagnostic> items;
+  /// The diagnostics pushed by one thread, in the order it pushed them, with
+  /// adjacent identical ones already coalesced.
+  struct Shard {
+    std::thread::id owner;
+    std::vector<Diagnostic> items;
+    size_t pushed;
+  };
+
+  /// Distinguishes this collector in each thread's cached shard lookup.
+  const uint64_t id;
+
+  /// Guards the list of shards, not their contents.
+  mutable std::mutex shards_lock;
+  std::vector<std::unique_ptr<Shard>> shards;
+
+  /// The number of errors after which phases should stop, or `0` for no limit.
+  const size_t error_limit;
+  std::atomic<size_t> errors;
+
+  /// The merged diagnostics, rebuilt when anything was pushed since the last
+  /// read. `merged` is the number of pushes they were built from.
+  mutable std::vector<Diagnostic> items;
+  mutable size_t merged;
+
+  /// Returns the calling thread's shard, registering it if this is the first
+  /// time the thread pushes to this collector.
+  Shard &local_shard();
+
+  /// Brings `items` up to date with the shards.
+  void merge() const;
 
 public:
-  DiagCollect();
-  [[nodiscard]] auto begin() const;
-  [[nodiscard]] auto end() const;
+  /// Creates a collector that reports `limit_reached()` once `error_limit`
+  /// errors were pushed, counting a coalesced run once. Only the first
+  /// `error_limit` errors in position order are kept when merging, while
+  /// warnings and info are all kept. `0` means there is no limit.
+  explicit DiagCollect(size_t error_limit = 0);
 
-  /// Pushes the given diagnostic to the internal diagnostic vector.
+  DiagCollect(const DiagCollect &) = delete;
+  DiagCollect &operator=(const DiagCollect &) = delete;
+
+  [[nodiscard]] std::vector<Diagnostic>::const_iterator begin() const;
+  [[nodiscard]] std::vector<Diagnostic>::const_iterator end() const;
+  [[nodiscard]] size_t size() const;
+
+  /// Pushes the given diagnostic to the calling thread's shard.
   void push(const Diagnostic &diag);
 
-  /// Prints all of the currently stored diagnostics to `std::cout`.
-  void print_all() const;
+  /// Returns how many errors have been pushed so far, from any thread.
+  [[nodiscard]] size_t error_count() const;
+
+  /// Whether the error limit has been reached, or would be after `more` further
+  /// errors. Cheap enough to be polled by worker threads, which should stop
+  /// reporting once it returns `true`.
+  [[nodiscard]] bool limit_reached(size_t more = 0) const;
+
+  /// Prints all of the currently stored diagnostics to `os` in position order.
+  /// Positions are resolved in one sweep over the diagnostics, and the output
+  /// is written and flushed once.
+  void print_all(std::ostream &os = std::cout) const;
 };
 
 /* -------------------------------------------------------------------------- */
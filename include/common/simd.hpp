@@ -0,0 +1,51 @@
+#ifndef SIMD_H
+#define SIMD_H
+#include <cstddef>
+#include <cstdint>
+
+/// Vectorized byte-scanning primitives shared by the source and lexer code.
+/// Every routine has a scalar fallback; on x86 the widest supported instruction
+/// set (SSE2 or AVX2) is picked once at runtime.
+namespace simd {
+
+/// The instruction sets the scanners know how to use, widest last.
+enum class Level { Scalar, SSE2, AVX2 };
+
+/// Returns the instruction set the scanners use, which is the widest one the
+/// CPU supports unless it was lowered with `set_level()`.
+[[nodiscard]] Level active_level();
+
+/// Makes every scanner use `level`, or the widest instruction set the CPU
+/// supports if that is narrower. Lets benchmarks and tests compare the
+/// implementations against each other.
+void set_level(Level level);
+
+/// Returns how many times `byte` occurs in the first `size` bytes of `data`.
+[[nodiscard]] size_t count_byte(const char *data, size_t size, char byte);
+
+/// Writes the offset of every occurrence of `byte` in the first `size` bytes of
+/// `data` to `out`, in ascending order. `out` must have room for
+/// `count_byte(data, size, byte)` entries.
+void find_all(const char *data, size_t size, char byte, uint32_t *out);
+
+/// The outcome of checking a buffer for UTF-8 validity.
+struct Utf8Check {
+  /// Offset of the first byte that doesn't begin or continue a valid UTF-8
+  /// sequence, or the size of the buffer if it is entirely valid.
+  size_t error;
+
+  /// Whether the buffer is entirely ASCII, which implies that it is valid.
+  bool ascii;
+};
+
+/// Validates the first `size` bytes of `data` as UTF-8, rejecting overlong
+/// encodings, surrogates and codepoints past U+10FFFF.
+[[nodiscard]] Utf8Check check_utf8(const char *data, size_t size);
+
+/// Returns how many UTF-8 codepoints begin in the first `size` bytes of
+/// `data`, which is the number of bytes that aren't continuation bytes.
+[[nodiscard]] size_t count_codepoints(const char *data, size_t size);
+
+}; // namespace simd
+
+#endif
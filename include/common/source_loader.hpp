@@ -0,0 +1,59 @@
+#ifndef SOURCE_LOADER_H
+#define SOURCE_LOADER_H
+#include "common/span.hpp"
+#include <cstddef>
+#include <expected>
+#include <functional>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+/// Loads many source files at once. On Linux every open, size query, read and
+/// close is submitted through one io_uring so a whole project costs a handful
+/// of syscalls; elsewhere, or where io_uring is unavailable, a pool of threads
+/// loads files with plain `pread`.
+///
+/// Sources are handed out one by one as their reads complete rather than once
+/// the whole batch is done, so that callers can start lexing the first file
+/// while the rest are still in flight.
+class SourceLoader {
+public:
+  /// Which mechanism the loader uses to perform reads.
+  enum class Backend { IoUring, ThreadPool };
+
+  /// The outcome of loading one file.
+  using Result = std::expected<std::unique_ptr<Source>, std::error_code>;
+
+  /// Receives each loaded file along with its index in the list of paths.
+  using Callback = std::function<void(size_t index, Result result)>;
+
+private:
+  Backend backend;
+  unsigned threads;
+
+  void load_io_uring(const std::vector<std::string> &paths,
+                     const Callback &on_loaded) const;
+  void load_thread_pool(const std::vector<std::string> &paths,
+                        const Callback &on_loaded) const;
+
+public:
+  /// Creates a loader that uses io_uring if the kernel supports it. `threads`
+  /// sizes the fallback thread pool, `0` meaning one per hardware thread.
+  explicit SourceLoader(unsigned threads = 0);
+
+  /// Creates a loader that uses `backend`, if it is available.
+  SourceLoader(Backend backend, unsigned threads = 0);
+
+  /// Returns the backend this loader actually uses.
+  [[nodiscard]] Backend get_backend() const;
+
+  /// Loads every file in `paths` and calls `on_loaded` exactly once for each,
+  /// in completion order, returning once all of them have been delivered. With
+  /// the io_uring backend the callback runs on the calling thread; with the
+  /// thread pool it runs concurrently on the pool's threads.
+  void load(const std::vector<std::string> &paths,
+            const Callback &on_loaded) const;
+};
+
+#endif
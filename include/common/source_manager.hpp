@@ -0,0 +1,73 @@
+#ifndef SOURCE_MANAGER_H
+#define SOURCE_MANAGER_H
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <shared_mutex>
+#include <utility>
+#include <vector>
+
+struct Source;
+
+/// Gives every live `Source` its own range of a single 32-bit offset space,
+/// so that a location anywhere in the program fits in one `uint32_t` and a
+/// `Span` doesn't need to store which source it points into. A source's range
+/// covers its content plus one byte, so the EOF position has an offset too.
+///
+/// Sources register and unregister themselves on construction and
+/// destruction; everything else only looks offsets up. There is one manager
+/// for the whole process, accessed through `global()`, and it is safe to use
+/// from multiple threads.
+class SourceManager {
+  /// One registered source and the global offset its range begins at.
+  struct Entry {
+    uint32_t base;
+    uint32_t extent;
+    const Source *source;
+  };
+
+  /// Registered sources, in ascending order of `base`.
+  std::vector<Entry> entries;
+  mutable std::shared_mutex lock;
+
+  /// The offset just past the range handed out last, where the search for
+  /// the next free range starts.
+  uint64_t next;
+
+  SourceManager() : next(0) {}
+
+  /// Returns the first free offset at or after `from` with `extent` offsets
+  /// free after it, and the entry it goes in front of, or `std::nullopt` if
+  /// none is left before the end of the offset space.
+  [[nodiscard]] std::optional<std::pair<uint64_t, std::vector<Entry>::iterator>>
+  fit(uint64_t from, uint64_t extent);
+
+public:
+  SourceManager(const SourceManager &) = delete;
+  SourceManager &operator=(const SourceManager &) = delete;
+
+  /// Returns the process-wide manager.
+  static SourceManager &global();
+
+  /// Reserves an unused range for `source` and returns the global offset it
+  /// begins at. Ranges are handed out in increasing order, and those freed by
+  /// destroyed sources are only reused once the offset space after the last
+  /// one handed out runs out, so that a stale span keeps resolving to nothing
+  /// for as long as possible rather than into whichever source comes next.
+  /// Running out of offset space is fatal, since no span could point into the
+  /// source.
+  uint32_t add(const Source &source);
+
+  /// Releases the range held by `source`. Offsets into it no longer resolve,
+  /// until the offset space wraps around and the range is handed out again.
+  void remove(const Source &source);
+
+  /// Returns the source whose range contains the global `offset`, or `nullptr`
+  /// if it doesn't belong to any live source.
+  [[nodiscard]] const Source *find(uint32_t offset) const;
+
+  /// Returns how many sources are currently registered.
+  [[nodiscard]] size_t size() const;
+};
+
+#endif
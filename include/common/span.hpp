@@ -1,18 +1,70 @@
 #ifndef SPAN_H
 #define SPAN_H
+#include <cstdint>
+#include <expected>
 #include <iostream>
+#include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <vector>
+
+/// How many `'\0'` bytes are guaranteed to be readable directly after the last
+/// byte of every `Source::content`, whichever way the source was loaded. At
+/// least the width of the widest vector the lexer loads, so that its scanners
+/// and lookahead can read past the end of a token without bounds checks and
+/// stop at the first sentinel byte.
+constexpr size_t SOURCE_PADDING = 64;
 
 /// Stores all of the relevant componenets for some compilation unit, including
 /// it's string in memory, it's path, and the length of the file. Provides
 /// methods for getting the n'th line and related functionality.
+///
+/// The offset at which every line begins is indexed once on construction, so
+/// all line and column queries are a binary search over that table rather than
+/// a scan of the content.
+///
+/// The content is either owned as a string or, for sources loaded with
+/// `Source::map()`, a read-only view of the file mapped into memory. Either
+/// way it is exposed as the same `content` view. Sources are neither copyable
+/// nor movable since spans and views into them refer to them by address.
 struct Source {
-  const std::string content;
+private:
+  /// Backs `content` for sources built from a string, padded with
+  /// `SOURCE_PADDING` trailing `'\0'` bytes. Empty for mapped sources.
+  std::string storage;
+
+  /// The start and length of the memory mapping backing `content`, if any.
+  void *mapping;
+  size_t mapping_size;
+
+  Source(void *mapping, size_t mapping_size, size_t size, std::string path);
+
+  /// Validates the content as UTF-8 and fills in `invalid_utf8` and `ascii`.
+  void check_encoding();
+
+public:
+  const std::string_view content;
   const std::string path;
   size_t size;
 
+  /// Byte offset of the first character of every line, in ascending order.
+  /// Always begins with `0`, so it has one entry per line.
+  const std::vector<uint32_t> line_starts;
+
+  /// The global offset of this source's first byte, assigned by the
+  /// `SourceManager` for as long as the source is alive.
+  const uint32_t base;
+
+  /// Offset of the first byte that isn't valid UTF-8, if there is one. The
+  /// content is validated once on construction.
+  std::optional<uint32_t> invalid_utf8;
+
+  /// Whether the content is pure ASCII, so that columns are byte counts.
+  bool ascii;
+
   Source(std::string content, std::string path);
 
   /// Creates a new source from just a string. This should be used to create
@@ -20,31 +72,78 @@ struct Source {
   /// loaded from the OS.
   Source(std::string content);
 
+  /// Loads the file at `path` by mapping it read-only into memory, so lexing
+  /// can start without copying it. The pages are shared with every other
+  /// process mapping the same file. Falls back to reading the file into memory
+  /// on platforms without `mmap`.
+  static std::expected<std::unique_ptr<Source>, std::error_code>
+  map(std::string path);
+
+  Source(const Source &) = delete;
+  Source &operator=(const Source &) = delete;
+  ~Source();
+
   /// Returns the ln'th line in the source content. `ln` is 1-based.
   [[nodiscard]] std::string_view line(size_t ln) const;
+
+  /// Returns the 1-based number of the line containing the byte at `offset`.
+  /// A newline character belongs to the line it terminates.
+  [[nodiscard]] size_t line_of(size_t offset) const;
+
+  /// Returns the byte offset at which the ln'th line begins. `ln` is 1-based
+  /// and must not exceed the number of lines.
+  [[nodiscard]] size_t line_start(size_t ln) const;
+
+  /// Returns the 1-based column of the byte at `offset`, counted in UTF-8
+  /// codepoints from the start of its line.
+  [[nodiscard]] size_t column_of(size_t offset) const;
 };
 
 /// Points to some bytes in a compilation unit using a standard span model
 /// (`offset` + `length`), all measured in bytes. Provides methods to compute
 /// attributes about the span like line number and column number.
+///
+/// The offset is global (see `SourceManager`), so a span is 8 bytes and
+/// trivially copyable, and the source it points into is looked up through the
+/// manager when needed.
 struct Span {
-  const Source &source;
-  const size_t offset;
-  const size_t length;
+  uint32_t offset;
+  uint32_t length;
 
+  /// Creates a span from an `offset` relative to the start of `source`, which
+  /// should be no larger than `source.size`.
   Span(const Source &source, size_t offset, size_t length);
 
+  /// Creates a span from a global offset.
+  constexpr Span(uint32_t offset, uint32_t length)
+      : offset(offset), length(length) {}
+
+  /// Returns the source this span points into, or `nullptr` if that source has
+  /// been destroyed.
+  [[nodiscard]] const Source *source() const;
+
   /// Fetch the line number, returns `-1` if out of bounds. Line numbers are
   /// 1-based.
   [[nodiscard]] std::optional<size_t> line_number() const;
 
   /// Fetch the column number, returns `-1` if out of bounds. Column numbers are
-  /// 1-based.
+  /// 1-based and count codepoints, not bytes.
   [[nodiscard]] std::optional<size_t> column_number() const;
 
   /// Returns a string view containing the bytes that this span points to.
   /// Returns an empty `string_view` if out of bounds.
   [[nodiscard]] std::string_view lexeme() const;
+
+  /// Same as `line_number()`, in a `source` the caller already holds, so that
+  /// the `SourceManager` isn't consulted and its lock isn't taken. Prefer this
+  /// on hot paths. A span that isn't in `source` is out of bounds.
+  [[nodiscard]] std::optional<size_t> line_number(const Source &source) const;
+
+  /// Same as `column_number()`, in a `source` the caller already holds.
+  [[nodiscard]] std::optional<size_t> column_number(const Source &source) const;
+
+  /// Same as `lexeme()`, in a `source` the caller already holds.
+  [[nodiscard]] std::string_view lexeme(const Source &source) const;
 };
 
 /* -------------------------------------------------------------------------- */
@@ -53,4 +152,7 @@ struct Span {
 
 std::ostream &operator<<(std::ostream &os, const Span &span);
 
+static_assert(sizeof(Span) == 8);
+static_assert(std::is_trivially_copyable_v<Span>);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,37 @@
+#ifndef STREAM_SOURCE_H
+#define STREAM_SOURCE_H
+#include <cstddef>
+#include <expected>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <vector>
+
+/// Refers to how many bytes a `StreamSource` reads at a time by default.
+constexpr size_t DEFAULT_STREAM_CHUNK_SIZE = 64 * 1024;
+
+/// A compilation unit read incrementally from a file descriptor, such as stdin
+/// or a pipe, one bounded chunk at a time rather than loaded whole. Unlike a
+/// `Source` it never holds more than one chunk of the input.
+class StreamSource {
+  int fd;
+  std::vector<char> buffer;
+  bool finished;
+
+public:
+  const std::string path;
+
+  /// Reads from `fd`, which stays owned by the caller. `path` is only used to
+  /// name the stream in diagnostics.
+  StreamSource(int fd, std::string path = "<stdin>",
+               size_t chunk_size = DEFAULT_STREAM_CHUNK_SIZE);
+
+  /// Blocks until more input arrives and returns it. The view is valid until
+  /// the next call. Returns an empty view once the stream has ended.
+  std::expected<std::string_view, std::error_code> next();
+
+  /// Returns whether the end of the stream has been reached.
+  [[nodiscard]] bool at_end() const;
+};
+
+#endif
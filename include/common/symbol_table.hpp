@@ -0,0 +1,104 @@
+#ifndef SYMBOL_TABLE_H
+#define SYMBOL_TABLE_H
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+/// Refers to an interned name, so that names can be compared by comparing
+/// their symbols. Symbols are only meaningful to the table that made them.
+using Symbol = uint32_t;
+
+/// The symbol of tokens that don't name anything. No name is interned as it.
+constexpr Symbol NO_SYMBOL = 0;
+
+/// Interns names, handing out the same `Symbol` for equal names, from any
+/// number of threads at once. Names are copied into the table, so symbols
+/// outlive the sources their names came from.
+///
+/// The table is split into shards picked by the hash of each name. Looking a
+/// name up never takes a lock: each shard's hash table is published through an
+/// atomic pointer, and its slots are only ever filled, never changed. Only
+/// interning a name that isn't in the table yet locks its shard, so threads
+/// adding different names rarely wait on each other.
+class SymbolTable {
+  static constexpr size_t SHARD_BITS = 6;
+  static constexpr size_t SHARDS = size_t(1) << SHARD_BITS;
+
+  /// The names of a shard are stored by index in segments that double in
+  /// size, so that they never move and can be read without a lock.
+  static constexpr size_t FIRST_SEGMENT = 64;
+  static constexpr size_t SEGMENTS = 32 - SHARD_BITS - 6 + 1;
+
+  /// An open addressed hash table of symbols. Each slot holds the upper half
+  /// of the hash of its name next to its symbol, or `0` if it is empty.
+  struct Slots {
+    size_t mask;
+    std::unique_ptr<std::atomic<uint64_t>[]> slots;
+
+    explicit Slots(size_t capacity);
+  };
+
+  struct alignas(64) Shard {
+    std::atomic<Slots *> slots;
+    std::array<std::atomic<std::string_view *>, SEGMENTS> segments;
+
+    /// Everything below is only used by writers, under `lock`.
+    std::mutex lock;
+    uint32_t count;
+    std::vector<std::unique_ptr<Slots>> tables;
+    std::vector<std::unique_ptr<char[]>> arena;
+    char *arena_next;
+    size_t arena_left;
+
+    Shard();
+    ~Shard();
+  };
+
+  std::unique_ptr<Shard[]> shards;
+
+  /// Copies `name` into the arena of `shard` and returns the copy.
+  static std::string_view store(Shard &shard, std::string_view name);
+
+  /// Returns the segment holding the name of the `index`th symbol of a
+  /// shard, and where in that segment it is.
+  static std::pair<size_t, size_t> locate(size_t index);
+
+  /// Looks `name` up in `slots` without locking.
+  std::optional<Symbol> probe(const Slots &slots, std::string_view name,
+                              uint64_t hash) const;
+
+public:
+  SymbolTable();
+
+  SymbolTable(const SymbolTable &) = delete;
+  SymbolTable &operator=(const SymbolTable &) = delete;
+
+  /// Returns the table shared by every lexer of the process.
+  [[nodiscard]] static SymbolTable &global();
+
+  /// Hashes `name` the way the table does, for callers that want to compute
+  /// the hash once and pass it along.
+  [[nodiscard]] static uint64_t hash(std::string_view name);
+
+  /// Returns the symbol of `name`, interning it first if it isn't yet.
+  /// `hash` must be `hash(name)`. Aborts once a shard runs out of the names
+  /// that fit in a 32-bit symbol.
+  [[nodiscard]] Symbol intern(std::string_view name, uint64_t hash);
+  [[nodiscard]] Symbol intern(std::string_view name);
+
+  /// Returns the symbol of `name` if it was interned, without locking.
+  [[nodiscard]] std::optional<Symbol> find(std::string_view name) const;
+
+  /// Returns the name that `symbol` was interned for, without locking. Must
+  /// only be given symbols returned by this table.
+  [[nodiscard]] std::string_view name(Symbol symbol) const;
+};
+
+#endif
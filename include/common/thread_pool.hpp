@@ -0,0 +1,55 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// A fixed set of worker threads for fork-join parallel loops. The calling
+/// thread takes part in every loop too, so a pool of `n` threads spawns `n - 1`
+/// workers and a pool of one runs everything inline.
+class ThreadPool {
+  std::vector<std::thread> workers;
+
+  std::mutex lock;
+  std::condition_variable wake;
+  std::condition_variable done;
+
+  /// The loop currently being run, shared with the workers under `lock`.
+  const std::function<void(size_t)> *job;
+  size_t count;
+  std::atomic<size_t> next;
+
+  /// Bumped for every loop so that each worker joins each loop exactly once.
+  size_t generation;
+
+  /// How many workers haven't finished the current loop yet.
+  size_t active;
+  bool stopping;
+
+  /// Claims and runs iterations of the current loop until there are none left.
+  void drain(const std::function<void(size_t)> &job, size_t count);
+
+  void work();
+
+public:
+  /// Creates a pool of `threads` threads, or one per hardware thread if `0`.
+  explicit ThreadPool(unsigned threads = 0);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool &) = delete;
+  ThreadPool &operator=(const ThreadPool &) = delete;
+
+  /// Returns how many threads run each loop, including the calling thread.
+  [[nodiscard]] size_t size() const;
+
+  /// Calls `job(i)` for every `i` in `[0, count)`, spread across the pool, and
+  /// returns once all of the calls have finished. Calls happen in no particular
+  /// order. Must not be called from more than one thread at a time.
+  void run(size_t count, const std::function<void(size_t)> &job);
+};
+
+#endif
@@ -2,12 +2,62 @@
 #define LEXER_H
 #include "common/diagnostic.hpp"
 #include "common/span.hpp"
+#include "common/thread_pool.hpp"
 #include "lexer/token.hpp"
+#include "lexer/token_ring.hpp"
+#include <cstddef>
+#include <cstdint>
 #include <optional>
+#include <string>
+#include <string_view>
+
+/// The most characters past the end of a token that the lexer looks at to
+/// decide where that token ends. A token followed by at least this many more
+/// characters can't change when more input is appended.
+constexpr unsigned MAX_LOOKAHEAD = 2;
+
+/// How many bytes of a source each thread lexes at once by default, when
+/// lexing in parallel. Sources no larger than this are lexed sequentially.
+constexpr size_t DEFAULT_LEX_CHUNK_SIZE = 1024 * 1024;
+
+/// How many bytes of a source are lexed into each batch of tokens published to
+/// a `TokenRing`.
+constexpr size_t TOKEN_BATCH_BYTES = 16 * 1024;
+
+/// Returns the value of the string literal `token` in `source` without its
+/// quotes. Escapes are only decoded when this is called: a literal without any
+/// is returned as a view into the source, without copying, and any other is
+/// decoded into `buffer`, which the returned view then points into. The
+/// literal must have been lexed without diagnostics.
+[[nodiscard]] std::string_view decode_string(const Source &source,
+                                             const Token &token,
+                                             std::string &buffer);
+
+/// Returns the value of the decimal literal `token` in `source`, correctly
+/// rounded, or `std::nullopt` if it is too large for a `double` (which the
+/// lexer reports). A literal too small for even the smallest subnormal rounds
+/// to `0`. Parsed in place with `std::from_chars()`, without allocating or
+/// looking at the locale.
+[[nodiscard]] std::optional<double> decode_decimal(const Source &source,
+                                                   const Token &token);
+
+/// An edit of a source, replacing the `removed` bytes at `offset` with the
+/// `inserted` text.
+struct SourceEdit {
+  size_t offset;
+  size_t removed;
+  std::string_view inserted;
+};
 
 /// Used to tokenize a given source file. Takes in some source string and writes
 /// the tokens into a `TokenCollect`. Will also emit diagnostics to a
-/// `DiagCollect` if any are found. Errors will not abort tokenization.
+/// `DiagCollect` if any are found. Errors will not abort tokenization unless
+/// they reach the error limit of the `DiagCollect`, in which case the tokens
+/// lexed so far are ended with an `Eof` token.
+///
+/// Comments are either `#` to the end of the line or `/* */`, which may nest.
+/// They are skipped, and only written to the `TokenCollect` as trivia if it
+/// keeps trivia.
 class Lexer {
   /// The source file to tokenize and the source string to use.
   const Source &source;
@@ -22,43 +72,97 @@ class Lexer {
   size_t cursor;
 
 private:
-  /// Returns whether or not the lexer will be out of bounds at `k` tokens
-  /// ahead, which is `0` by default.
-  bool is_at_end(unsigned k = 0) const;
+  /// Returns whether the cursor is on the sentinel padding past the last
+  /// character. Only needs checking when `current()` returns `'\0'`.
+  bool is_at_end() const;
 
-  /// Returns the current character pointed to by `cursor`, will return `\0` if
+  /// Returns the current character pointed to by `cursor`, which is `'\0'` at
   /// EOF.
   char current() const;
 
-  /// Returns the `k` 'th character from the lexer's cursor.
+  /// Returns the `k` 'th character from the lexer's cursor. Never bounds
+  /// checked: past the end it reads the source's `'\0'` sentinel padding.
   char peek(unsigned k = 1) const;
 
-  /// Will move the lexer's cursor ahead `k` times. Will not move past
-  /// `source.size`.
+  /// Will move the lexer's cursor ahead `k` times. Must not move past
+  /// `source.size`, which no token does since none contains the sentinel.
   void eat(unsigned k = 1);
 
   /// Will advance the lexer until the `current()` returns something that isn't
   /// whitespace (newlines are not included in "whitespace").
   void skip_whitespace();
 
+  /// Will advance the lexer past a `#` comment, up to the newline ending it,
+  /// which is found with `memchr()`.
+  void skip_line_comment();
+
+  /// Will advance the lexer past a `/* */` comment, which may nest, jumping
+  /// from one `'*'` or `'/'` to the next. Emits a diagnostic if it is never
+  /// closed.
+  void skip_block_comment();
+
   /// Will tokenize as much of an identifier as it can. Before returning, it
   /// will check to see if that identifier is a keyword.
   Token lex_identifier();
 
   /// Will tokenize as much of a number as possible, along with distinguishing
-  /// between integer and decimal literals.
+  /// between integer and decimal literals. The value of an integer is carried
+  /// by its token (see `Token::integer()`); a literal too large for its type
+  /// is reported here.
   Token lex_number();
 
+  /// Will tokenize the longest operator that starts at the cursor.
+  Token lex_operator();
+
+  /// Will tokenize a string literal, scanning its body a vector at a time.
+  /// Escapes are only validated here, not decoded (see `decode_string()`).
+  /// Emits a diagnostic if the literal has an invalid escape or isn't closed
+  /// before the end of its line.
+  std::optional<Token> lex_string();
+
   /// Will attempt to produce one token. Will emit an diagnostic if it runs into
   /// an error.
   std::optional<Token> lex_once();
 
+  /// Reports the encoding of the source and resets the cursor, then returns
+  /// whether lexing should go on.
+  bool lex_start();
+
+  /// Lexes tokens until the cursor reaches `end`, or the end of the source, or
+  /// the error limit. The final `Eof` token is not pushed. Returns whether it
+  /// stopped at the error limit. The last token may run past `end`.
+  bool lex_until(size_t end);
+
 public:
   Lexer(const Source &source, TokenCollect &tokens, DiagCollect &diagnostics);
 
   /// Tokenizes the entire source file and writes all encountered tokens and
   /// diagnostics to their respective collections.
   void lex();
+
+  /// Tokenizes the entire source file like `lex()`, with the same output, but
+  /// splits it into chunks of about `chunk_size` bytes that are lexed on the
+  /// threads of `pool`. Chunks start after a newline and are lexed as if they
+  /// started at a token, then stitched together in order. A chunk whose start
+  /// turns out to be inside a token, or whose errors would reach the error
+  /// limit, is lexed again on the calling thread.
+  void lex(ThreadPool &pool, size_t chunk_size = DEFAULT_LEX_CHUNK_SIZE);
+
+  /// Tokenizes the entire source file like `lex()`, but publishes the tokens
+  /// to `ring` in batches of about `TOKEN_BATCH_BYTES` bytes of source as it
+  /// goes, so that a parser on another thread can consume them. The token
+  /// collection only holds the batch being lexed.
+  void lex(TokenRing &ring);
+
+  /// Patches `tokens`, which hold the tokens of a source that `edit` turned
+  /// into this lexer's source, instead of lexing it all again. Lexing restarts
+  /// at the first token the edit could have changed and stops as soon as a
+  /// token past the edit starts where an old one did, after which the old
+  /// tokens are kept and only moved. Only diagnostics within the re-lexed
+  /// range are reported. Returns how many tokens were lexed.
+  ///
+  /// The source before the edit doesn't need to be alive.
+  size_t relex(const SourceEdit &edit);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,87 @@
+#ifndef SCAN_H
+#define SCAN_H
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/// The character classes of the lexer, looked up in a table built at compile
+/// time, and scanners that find where a run of one class ends. The scanners
+/// classify 16 or 32 bytes at once with the instruction set picked by
+/// `simd::active_level()`, or one byte at a time on other platforms.
+///
+/// Classification is ASCII-only and locale-independent. Every byte of a
+/// multi-byte UTF-8 sequence is accepted as part of an identifier, the source
+/// having already been validated as UTF-8.
+namespace scan {
+
+/// The classes a byte can belong to, as bit flags.
+constexpr uint8_t WHITESPACE = 1 << 0;
+constexpr uint8_t DIGIT = 1 << 1;
+constexpr uint8_t IDENT_START = 1 << 2;
+constexpr uint8_t IDENT_CONT = 1 << 3;
+constexpr uint8_t STRING_BODY = 1 << 4;
+constexpr uint8_t COMMENT_BODY = 1 << 5;
+
+/// The classes of every byte value. Whitespace separates tokens and doesn't
+/// include newlines. A string body is anything that neither ends a string
+/// literal nor starts an escape in one, and a comment body anything that can't
+/// open or close a block comment.
+constexpr std::array<uint8_t, 256> CLASSES = [] {
+  std::array<uint8_t, 256> table{};
+  for (unsigned c = 0; c < 256; ++c) {
+    if (c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\b')
+      table[c] |= WHITESPACE;
+    if (c >= '0' && c <= '9')
+      table[c] |= DIGIT | IDENT_CONT;
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' ||
+        c >= 0x80)
+      table[c] |= IDENT_START | IDENT_CONT;
+    if (c != '"' && c != '\\' && c != '\n' && c != '\0')
+      table[c] |= STRING_BODY;
+    if (c != '*' && c != '/' && c != '\0')
+      table[c] |= COMMENT_BODY;
+  }
+  return table;
+}();
+
+/// Whether `ch` belongs to any of the classes in `mask`.
+constexpr bool is_class(char ch, uint8_t mask) {
+  return (CLASSES[static_cast<unsigned char>(ch)] & mask) != 0;
+}
+
+constexpr bool is_digit(char ch) { return is_class(ch, DIGIT); }
+constexpr bool is_ident_start(char ch) { return is_class(ch, IDENT_START); }
+constexpr bool is_ident_cont(char ch) { return is_class(ch, IDENT_CONT); }
+constexpr bool is_number_start(char ch) { return is_class(ch, DIGIT); }
+constexpr bool is_whitespace(char ch) { return is_class(ch, WHITESPACE); }
+constexpr bool is_string_body(char ch) { return is_class(ch, STRING_BODY); }
+constexpr bool is_comment_body(char ch) { return is_class(ch, COMMENT_BODY); }
+
+// The scanners take no size. `'\0'` belongs to no class, so every run ends at
+// the latest on the sentinel padding of a `Source`, and the scanners read up
+// to one vector past the end of the run. `data` must therefore point into a
+// buffer ending with `SOURCE_PADDING` `'\0'` bytes, like `Source::content`.
+
+/// Returns how many bytes at `data` are whitespace before the first byte that
+/// isn't.
+[[nodiscard]] size_t span_whitespace(const char *data);
+
+/// Returns how many bytes at `data` continue an identifier before the first
+/// byte that can't.
+[[nodiscard]] size_t span_identifier(const char *data);
+
+/// Returns how many bytes at `data` are digits before the first byte that
+/// isn't.
+[[nodiscard]] size_t span_digits(const char *data);
+
+/// Returns how many bytes at `data` are the body of a string literal before
+/// the first quote, backslash, newline or `'\0'`.
+[[nodiscard]] size_t span_string(const char *data);
+
+/// Returns how many bytes at `data` are the body of a block comment before the
+/// first `'*'`, `'/'` or `'\0'`.
+[[nodiscard]] size_t span_comment(const char *data);
+
+}; // namespace scan
+
+#endif
@@ -0,0 +1,102 @@
+#ifndef STREAM_LEXER_H
+#define STREAM_LEXER_H
+#include "common/diagnostic.hpp"
+#include "common/stream_source.hpp"
+#include "lexer/token.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <system_error>
+
+/// Where a token or diagnostic sits within a whole stream. Lines and columns
+/// are 1-based, and columns count codepoints.
+struct StreamPosition {
+  uint64_t offset;
+  uint64_t line;
+  uint64_t column;
+};
+
+/// The longest run of errors carried from one window of a `StreamLexer` into
+/// the next so that it can grow. A longer run is handed out as it is and the
+/// rest of it reported as a new run, rather than lexing it again with every
+/// chunk.
+constexpr size_t MAX_CARRIED_RUN = 4 * 1024;
+
+/// Tokenizes input that arrives in chunks, handing tokens and diagnostics to
+/// consumers as soon as they are known instead of collecting them.
+///
+/// Each call to `feed()` lexes a window made of the new chunk plus whatever
+/// was carried over from the previous one. Tokens that end within
+/// `MAX_LOOKAHEAD` characters of the window's end could still grow, so lexing
+/// suspends there and that tail is carried into the next window, as is a
+/// diagnostic that could still change, up to `MAX_CARRIED_RUN` bytes of it
+/// for a run of errors. Memory is therefore bounded by the chunk size plus the
+/// longest token or carried run, however long the stream is.
+///
+/// Like lexing a whole source, the stream ends with the EOF token once the
+/// error limit is reached: the rest of the input is only counted, not lexed.
+///
+/// Tokens and diagnostics handed out point into the current window, so their
+/// spans and lexemes are only valid during the callback and their line and
+/// column numbers are relative to the window. The `StreamPosition` passed
+/// alongside them is their position in the stream as a whole.
+class StreamLexer {
+public:
+  using TokenSink =
+      std::function<void(const Token &token, const StreamPosition &position)>;
+  using DiagnosticSink = std::function<void(const Diagnostic &diag,
+                                            const StreamPosition &position)>;
+
+private:
+  const std::string path;
+  TokenSink on_token;
+  DiagnosticSink on_diagnostic;
+
+  /// The tail of the last window that hasn't been lexed for good yet.
+  std::string carry;
+
+  /// The stream position of the first character of `carry`.
+  StreamPosition position;
+
+  /// The number of errors after which lexing stops, or `0` for no limit, and
+  /// the number handed out so far.
+  const size_t error_limit;
+  size_t errors;
+
+  /// Whether the error limit was reached, so that the input left is skipped.
+  bool stopped;
+
+  /// Whether invalid UTF-8 was reported already. Like lexing a whole source,
+  /// only the first invalid byte of the stream is reported, rather than the
+  /// first of every window.
+  bool reported_encoding;
+
+  /// Returns the stream position of `offset` in `window`, which starts at
+  /// `position`.
+  [[nodiscard]] StreamPosition locate(const Source &window,
+                                      size_t offset) const;
+
+  /// Lexes `carry` and hands out everything up to where it suspends, or all
+  /// of it including the EOF token if `final`.
+  void lex_window(bool final);
+
+public:
+  /// Creates a lexer that stops after `error_limit` errors, or never if it
+  /// is `0`.
+  StreamLexer(std::string path, TokenSink on_token,
+              DiagnosticSink on_diagnostic, size_t error_limit = 0);
+
+  /// Appends `chunk` to the input and hands out every token that it completes.
+  void feed(std::string_view chunk);
+
+  /// Ends the input, handing out the remaining tokens and the EOF token.
+  void finish();
+
+  /// Feeds every chunk of `stream` and then finishes.
+  std::expected<void, std::error_code> lex(StreamSource &stream);
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef TOKEN_RING_H
+#define TOKEN_RING_H
+#include "lexer/token.hpp"
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+/// Refers to how many batches of tokens a `TokenRing` holds by default.
+constexpr size_t DEFAULT_TOKEN_RING_BATCHES = 8;
+
+/// A bounded single-producer, single-consumer queue of tokens, used to run the
+/// lexer on its own thread while the parser consumes its output.
+///
+/// The producer publishes whole batches of tokens, and the consumer reads
+/// tokens by their index in the token stream and releases batches once it is
+/// past them. Neither side takes a lock: each side only writes its own
+/// counter, and only blocks when the ring is full or it has caught up with the
+/// producer. At most `batches` batches are held at once, so memory is bounded
+/// by the batch size rather than by the size of the source.
+class TokenRing {
+  std::vector<std::vector<Token>> slots;
+
+  /// How many batches have been published, shifted left by one, with the low
+  /// bit set once the batch holding the `Eof` token is among them. Written by
+  /// the producer only.
+  alignas(64) std::atomic<size_t> published;
+
+  /// How many batches have been released, written by the consumer only.
+  alignas(64) std::atomic<size_t> released;
+
+  /// The index of the first token of the oldest unreleased batch. Only used
+  /// by the consumer.
+  alignas(64) size_t first;
+
+public:
+  /// Creates a ring of `batches` batches, which must be at least two.
+  explicit TokenRing(size_t batches = DEFAULT_TOKEN_RING_BATCHES);
+
+  TokenRing(const TokenRing &) = delete;
+  TokenRing &operator=(const TokenRing &) = delete;
+
+  /* ---- PRODUCER ---- */
+
+  /// Publishes the tokens of `batch` and clears it, waiting for the consumer
+  /// to release a batch first if the ring is full. The stream ends with the
+  /// batch holding the `Eof` token.
+  void publish(TokenCollect &batch);
+
+  /* ---- CONSUMER ---- */
+
+  /// Returns the token at `index` in the stream, waiting for it to be
+  /// published, or the `Eof` token if the stream ends before `index`. Must
+  /// not be given an index before one that was released.
+  [[nodiscard]] Token at(size_t index);
+
+  /// Releases every batch made only of tokens before `index`, letting the
+  /// producer reuse its slot.
+  void release(size_t index);
+
+  /// Releases everything until the producer is done, so it never waits on a
+  /// consumer that stopped reading early.
+  void drain();
+};
+
+#endif
@@ -3,18 +3,32 @@
 #include "common/diagnostic.hpp"
 #include "common/span.hpp"
 #include "lexer/token.hpp"
+#include "lexer/token_ring.hpp"
 #include "parser/ast.hpp"
 #include <optional>
 
 class Parser {
   const Source &source;
-  const TokenCollect &tokens;
+
+  /// Where the tokens come from: either a whole collection, or a ring that a
+  /// lexer on another thread is still publishing to.
+  const TokenCollect *tokens;
+  TokenRing *ring;
+
   DiagCollect &diagnostics;
   size_t cursor;
 
 public:
   Parser(const Source &source, const TokenCollect &tokens,
          DiagCollect &diagnostics);
+
+  /// Creates a parser that consumes tokens from `ring` as they are published,
+  /// waiting for the lexer whenever it catches up with it.
+  Parser(const Source &source, TokenRing &ring, DiagCollect &diagnostics);
+
+  /// Consumes the token stream up to its `Eof` token. There is no statement
+  /// grammar yet, so nothing is parsed; reading from a ring, this only lets
+  /// the lexer reuse each batch as soon as the cursor has passed it.
   void parse();
 
 private:
@@ -22,6 +36,14 @@ private:
   Token peek(unsigned k = 1);
   Token current();
 
+  /// Returns the kind of the `k` 'th token from the cursor. Unlike `peek()` it
+  /// only reads the kind, which is all most lookahead needs.
+  Token::Kind peek_kind(unsigned k = 1);
+
+  /// Moves the parser's cursor ahead `k` tokens. Tokens before the cursor are
+  /// never looked at again, so they are released when reading from a ring.
+  void eat(unsigned k = 1);
+
 public:
   std::optional<ast::Node> parse_primary();
   std::optional<ast::Node> parse_expr();
@@ -1,66 +1,145 @@
 #include "common/diagnostic.hpp"
+#include "common/simd.hpp"
+#include "common/source_manager.hpp"
 #include "common/span.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
 #include <string>
+#include <string_view>
+#include <thread>
 #include <utility>
+#include <vector>
 
 /* -------------------------------------------------------------------------- */
-/* STREAM INSERTION OVERLOADS */
+/* IMPLEMENTATION-PRIVATE HELPERS */
 /* -------------------------------------------------------------------------- */
 
-std::ostream &operator<<(std::ostream &os, const Diagnostic::Level &level) {
+std::string_view level_name(const Diagnostic::Level &level) {
   using enum Diagnostic::Level;
   switch (level) {
   case Error:
-    return os << "Error:";
+    return "Error:";
   case Warning:
-    return os << "Warning:";
+    return "Warning:";
   case Info:
-    return os << "Info:";
+    return "Info:";
   default:
-    return os << "<unknown severity>";
+    return "<unknown severity>";
   }
 }
 
-std::ostream &operator<<(std::ostream &os, const Diagnostic::Issue &issue) {
+std::string_view issue_name(const Diagnostic::Issue &issue) {
   using enum Diagnostic::Issue;
-#define X(name, repr, issue)                                                   \
+#define X(name, repr, level, phase, help)                                      \
   case name:                                                                   \
-    return os << repr;
+    return repr;
   switch (issue) {
     DIAGNOSTIC_ISSUES
   default:
-    return os << "<unknown kind>";
+    return "<unknown kind>";
   }
 #undef X
 }
 
-std::ostream &operator<<(std::ostream &os, const Diagnostic &diag) {
-  const auto maybe_y = diag.span.line_number();
-  const auto maybe_x = diag.span.column_number();
-  const std::string y =
-      maybe_y.has_value() ? std::to_string(maybe_y.value()) : "<y?>";
-  const std::string x =
-      maybe_x.has_value() ? std::to_string(maybe_x.value()) : "<x?>";
-
-  const auto line = diag.span.source.line(maybe_y.value());
+/// The help message of every issue, indexed by the issue.
+constexpr std::string_view HELP[] = {
+#define X(name, repr, level, phase, help) help,
+    DIAGNOSTIC_ISSUES
+#undef X
+};
 
-  os << diag.level << " " << diag.issue << "  -> " << diag.span << "\n"
-     << "  " << line << "\n"
-     << "Help: " << diag.message;
+/// Appends `arg` to `out` the way it is substituted into a help message. A
+/// lexeme is sliced out of `source` when it points into it, which it does
+/// when `source` is the diagnostic's own, and only looked up otherwise.
+void format_arg(std::string &out, const Diagnostic::Arg &arg,
+                const Source *source) {
+  using enum Diagnostic::Arg::Kind;
+  switch (arg.kind) {
+  case None:
+    return;
+  case Text:
+    out += arg.text;
+    return;
+  case Lexeme: {
+    auto lexeme = source != nullptr ? arg.lexeme.lexeme(*source)
+                                    : std::string_view();
+    if (lexeme.size() != arg.lexeme.length)
+      lexeme = arg.lexeme.lexeme();
+    for (const char c : lexeme) {
+      const auto byte = static_cast<unsigned char>(c);
+      if (byte >= 0x20 && byte != 0x7f) {
+        out += c;
+        continue;
+      }
+      constexpr char DIGITS[] = "0123456789abcdef";
+      out += "\\x";
+      out += DIGITS[byte >> 4];
+      out += DIGITS[byte & 0xf];
+    }
+    return;
+  }
+  }
+}
 
-  return os;
+/// Appends the help message of `diag` to `out`, substituting its arguments
+/// for the `{0}` and `{1}` placeholders. `source` is the source of `diag`, if
+/// the caller has already looked it up.
+void format_message(std::string &out, const Diagnostic &diag,
+                    const Source *source) {
+  const auto help = HELP[static_cast<size_t>(diag.issue)];
+  for (size_t i = 0; i < help.size(); ++i) {
+    if (help[i] == '{' && i + 2 < help.size() && help[i + 2] == '}' &&
+        (help[i + 1] == '0' || help[i + 1] == '1')) {
+      format_arg(out, diag.args[help[i + 1] - '0'], source);
+      i += 2;
+      continue;
+    }
+    out += help[i];
+  }
 }
 
-/* -------------------------------------------------------------------------- */
-/* IMPLEMENTATION-PRIVATE HELPERS */
-/* -------------------------------------------------------------------------- */
+/// Where a diagnostic points, resolved ahead of formatting it so that the
+/// renderer can resolve many of them at once.
+struct Location {
+  const Source *source;
+  std::optional<size_t> line;
+  std::optional<size_t> column;
+};
+
+/// Appends `diag` to `out` in the same format for both single diagnostics and
+/// the batched renderer, without a trailing newline.
+void format_into(std::string &out, const Diagnostic &diag,
+                 const Location &at) {
+  const auto line = at.source != nullptr && at.line.has_value()
+                        ? at.source->line(at.line.value())
+                        : std::string_view();
+
+  out += level_name(diag.level);
+  out += ' ';
+  out += issue_name(diag.issue);
+  out += "  -> ";
+  out += at.source != nullptr ? std::string_view(at.source->path)
+                              : std::string_view("<unknown>");
+  out += ':';
+  out += at.line.has_value() ? std::to_string(at.line.value()) : "<y?>";
+  out += ':';
+  out += at.column.has_value() ? std::to_string(at.column.value()) : "<x?>";
+  out += "\n  ";
+  out += line;
+  out += "\nHelp: ";
+  format_message(out, diag, at.source);
+}
 
 constexpr Diagnostic::Level level_from_issue(const Diagnostic::Issue &kind) {
   using enum Diagnostic::Level;
   using enum Diagnostic::Issue;
 
-#define X(name, repr, severity)                                                \
+#define X(name, repr, severity, phase, help)                                   \
   case name:                                                                   \
     return severity;
 
@@ -72,28 +151,315 @@ constexpr Diagnostic::Level level_from_issue(const Diagnostic::Issue &kind) {
 #undef X
 }
 
+constexpr Diagnostic::Phase phase_from_issue(const Diagnostic::Issue &kind) {
+  using enum Diagnostic::Phase;
+  using enum Diagnostic::Issue;
+
+#define X(name, repr, severity, phase, help)                                   \
+  case name:                                                                   \
+    return phase;
+
+  switch (kind) {
+    DIAGNOSTIC_ISSUES
+  default:
+    return Internal;
+  }
+#undef X
+}
+
+/// The order in which merged diagnostics are listed: by position, then by
+/// phase, then by everything else so that equal keys are identical
+/// diagnostics and the order never depends on which shard they came from.
+bool merge_before(const Diagnostic &a, const Diagnostic &b) {
+  if (a.span.offset != b.span.offset)
+    return a.span.offset < b.span.offset;
+  if (a.phase() != b.phase())
+    return a.phase() < b.phase();
+  if (a.issue != b.issue)
+    return a.issue < b.issue;
+  if (a.span.length != b.span.length)
+    return a.span.length < b.span.length;
+  for (size_t i = 0; i < 2; ++i) {
+    const auto &x = a.args[i];
+    const auto &y = b.args[i];
+    if (x.kind != y.kind)
+      return x.kind < y.kind;
+    if (x.kind == Diagnostic::Arg::Kind::Lexeme &&
+        (x.lexeme.offset != y.lexeme.offset ||
+         x.lexeme.length != y.lexeme.length))
+      return std::pair(x.lexeme.offset, x.lexeme.length) <
+             std::pair(y.lexeme.offset, y.lexeme.length);
+    if (x.kind == Diagnostic::Arg::Kind::Text &&
+        std::string_view(x.text) != std::string_view(y.text))
+      return std::string_view(x.text) < std::string_view(y.text);
+  }
+  return false;
+}
+
+/// Whether `arg` of a diagnostic spanning `span` stays the same, or grows along
+/// with the span, when the diagnostic is coalesced with its neighbour.
+bool coalesces(const Diagnostic::Arg &arg, const Span &span,
+               const Diagnostic::Arg &next_arg, const Span &next_span) {
+  using enum Diagnostic::Arg::Kind;
+  if (arg.kind != next_arg.kind)
+    return false;
+  switch (arg.kind) {
+  case None:
+    return true;
+  case Text:
+    return std::string_view(arg.text) == std::string_view(next_arg.text);
+  case Lexeme:
+    return arg.lexeme.offset == span.offset &&
+           arg.lexeme.length == span.length &&
+           next_arg.lexeme.offset == next_span.offset &&
+           next_arg.lexeme.length == next_span.length;
+  }
+  return false;
+}
+
+/// Merges `next` into `run` when it reports the same issue with the same
+/// arguments directly after it, so that e.g. a run of invalid bytes is
+/// reported once with a span covering all of them.
+std::optional<Diagnostic> coalesce(const Diagnostic &run,
+                                   const Diagnostic &next) {
+  if (run.issue != next.issue ||
+      run.span.offset + run.span.length != next.span.offset)
+    return std::nullopt;
+  for (size_t i = 0; i < 2; ++i)
+    if (!coalesces(run.args[i], run.span, next.args[i], next.span))
+      return std::nullopt;
+
+  const Span span(run.span.offset, run.span.length + next.span.length);
+  const auto grow = [&](const Diagnostic::Arg &arg) {
+    return arg.kind == Diagnostic::Arg::Kind::Lexeme ? Diagnostic::Arg(span)
+                                                     : arg;
+  };
+  return Diagnostic(run.issue, span, grow(run.args[0]), grow(run.args[1]));
+}
+
+/* -------------------------------------------------------------------------- */
+/* STREAM INSERTION OVERLOADS */
+/* -------------------------------------------------------------------------- */
+
+std::ostream &operator<<(std::ostream &os, const Diagnostic::Level &level) {
+  return os << level_name(level);
+}
+
+std::ostream &operator<<(std::ostream &os, const Diagnostic::Issue &issue) {
+  return os << issue_name(issue);
+}
+
+std::ostream &operator<<(std::ostream &os, const Diagnostic &diag) {
+  // The source is looked up once, for the location and the arguments alike
+  Location at{.source = diag.span.source(),
+              .line = std::nullopt,
+              .column = std::nullopt};
+  if (at.source != nullptr) {
+    at.line = diag.span.line_number(*at.source);
+    at.column = diag.span.column_number(*at.source);
+  }
+  std::string out;
+  format_into(out, diag, at);
+  return os << out;
+}
+
 /* -------------------------------------------------------------------------- */
 /* DIAGNOSTIC IMPLEMENTATION */
 /* -------------------------------------------------------------------------- */
 
-Diagnostic::Diagnostic(Issue issue, const Span &span, std::string message)
+Diagnostic::Diagnostic(Issue issue, const Span &span, Arg first, Arg second)
     : level(level_from_issue(issue)), issue(issue), span(span),
-      message(std::move(message)) {}
+      args{first, second} {}
+
+Diagnostic::Phase Diagnostic::phase() const { return phase_from_issue(issue); }
+
+std::string Diagnostic::message() const {
+  std::string out;
+  format_message(out, *this, nullptr);
+  return out;
+}
 
 /* -------------------------------------------------------------------------- */
 /* COLLECTION IMPLEMENTATION */
 /* -------------------------------------------------------------------------- */
 
-DiagCollect::DiagCollect() : items({}) { items.reserve(16); }
+std::atomic<uint64_t> next_collector_id = 1;
+
+DiagCollect::DiagCollect(size_t error_limit)
+    : id(next_collector_id.fetch_add(1, std::memory_order_relaxed)),
+      error_limit(error_limit), errors(0), merged(0) {}
 
-auto DiagCollect::begin() const { return items.begin(); }
-auto DiagCollect::end() const { return items.end(); }
+DiagCollect::Shard &DiagCollect::local_shard() {
+  // Collector ids are never reused, so a stale cache entry can't match
+  thread_local uint64_t cached_id = 0;
+  thread_local Shard *cached = nullptr;
+  if (cached_id == id)
+    return *cached;
 
-void DiagCollect::print_all() const {
-  for (const auto &d : *this) {
-    std::cout << d << "\n";
+  const std::lock_guard guard(shards_lock);
+  const auto self = std::this_thread::get_id();
+  const auto it = std::find_if(shards.begin(), shards.end(),
+                               [&](const auto &s) { return s->owner == self; });
+  if (it != shards.end()) {
+    cached = it->get();
+  } else {
+    shards.push_back(std::make_unique<Shard>(Shard{self, {}, 0}));
+    shards.back()->items.reserve(16);
+    cached = shards.back().get();
   }
-  std::cout << std::endl;
+  cached_id = id;
+  return *cached;
 }
 
-void DiagCollect::push(const Diagnostic &diag) { items.push_back(diag); }
+void DiagCollect::merge() const {
+  const std::lock_guard guard(shards_lock);
+  size_t pushed = 0;
+  for (const auto &shard : shards)
+    pushed += shard->pushed;
+  if (pushed == merged)
+    return;
+
+  std::vector<const Diagnostic *> order;
+  order.reserve(pushed);
+  for (const auto &shard : shards)
+    for (const auto &diag : shard->items)
+      order.push_back(&diag);
+  std::sort(order.begin(), order.end(),
+            [](const Diagnostic *a, const Diagnostic *b) {
+              return merge_before(*a, *b);
+            });
+
+  // The furthest end of the errors kept so far from each phase. Anything a
+  // later phase reports inside (or right after) one of them is a cascade
+  constexpr size_t PHASES = static_cast<size_t>(Diagnostic::Phase::Internal);
+  std::optional<uint32_t> error_end[PHASES + 1];
+
+  items.clear();
+  items.reserve(order.size());
+  size_t kept_errors = 0;
+  for (const auto *diag : order) {
+    const auto phase = static_cast<size_t>(diag->phase());
+    bool cascade = false;
+    for (size_t p = 0; p < phase; ++p)
+      cascade |= error_end[p].has_value() &&
+                 error_end[p].value() >= diag->span.offset;
+    if (cascade)
+      continue;
+
+    // Runs are coalesced here too, since adjacent diagnostics may have been
+    // pushed by different threads
+    const auto run = items.empty() ? std::nullopt
+                                   : coalesce(items.back(), *diag);
+    const auto &kept = run.has_value() ? run.value() : *diag;
+    if (kept.level == Diagnostic::Level::Error) {
+      const uint32_t end = kept.span.offset + kept.span.length;
+      error_end[phase] = std::max(error_end[phase].value_or(0), end);
+    }
+
+    if (run.has_value()) {
+      items.pop_back();
+    } else if (diag->level == Diagnostic::Level::Error) {
+      // Only the first errors by position are kept, so that the result doesn't
+      // depend on how far other threads got before stopping. Errors past the
+      // limit still count as the cause of cascades, and anything that isn't
+      // an error is kept whatever follows it
+      if (error_limit != 0 && kept_errors == error_limit)
+        continue;
+      ++kept_errors;
+    }
+    items.push_back(kept);
+  }
+  merged = pushed;
+}
+
+std::vector<Diagnostic>::const_iterator DiagCollect::begin() const {
+  merge();
+  return items.begin();
+}
+std::vector<Diagnostic>::const_iterator DiagCollect::end() const {
+  merge();
+  return items.end();
+}
+size_t DiagCollect::size() const {
+  merge();
+  return items.size();
+}
+
+void DiagCollect::push(const Diagnostic &diag) {
+  auto &shard = local_shard();
+  ++shard.pushed;
+  if (!shard.items.empty()) {
+    const auto run = coalesce(shard.items.back(), diag);
+    if (run.has_value()) {
+      shard.items.pop_back();
+      shard.items.push_back(run.value());
+      return;
+    }
+  }
+
+  shard.items.push_back(diag);
+  if (diag.level == Diagnostic::Level::Error)
+    errors.fetch_add(1, std::memory_order_relaxed);
+}
+
+size_t DiagCollect::error_count() const {
+  return errors.load(std::memory_order_relaxed);
+}
+
+bool DiagCollect::limit_reached(size_t more) const {
+  return error_limit != 0 && error_count() + more >= error_limit;
+}
+
+void DiagCollect::print_all(std::ostream &os) const {
+  merge();
+
+  // The diagnostics are in order of position, so every source's line table is
+  // walked once, front to back, and the output is built in one buffer
+  std::string out;
+  out.reserve(items.size() * 128);
+  const Source *src = nullptr;
+  size_t line = 1;
+  size_t last_offset = 0;
+  size_t last_column = 1;
+
+  for (const auto &diag : items) {
+    const auto &span = diag.span;
+
+    // Only consult the source manager when the sweep crosses into a new source
+    if (src == nullptr || span.offset < src->base ||
+        span.offset - src->base > src->size) {
+      src = SourceManager::global().find(span.offset);
+      line = 1;
+      last_offset = 0;
+      last_column = 1;
+    }
+    Location at{.source = src, .line = std::nullopt, .column = std::nullopt};
+    if (src != nullptr && span.offset - src->base < src->size) {
+      const size_t local = span.offset - src->base;
+      while (line < src->line_starts.size() && src->line_starts[line] <= local)
+        ++line;
+      at.line = line;
+
+      // Count columns on from the previous diagnostic when it was on this line
+      const size_t line_start = src->line_starts[line - 1];
+      if (last_offset < line_start) {
+        last_offset = line_start;
+        last_column = 1;
+      }
+      last_column += src->ascii ? local - last_offset
+                                : simd::count_codepoints(
+                                      src->content.data() + last_offset,
+                                      local - last_offset);
+      last_offset = local;
+      if (local + span.length <= src->size)
+        at.column = last_column;
+    }
+    format_into(out, diag, at);
+    out += '\n';
+  }
+
+  // Write everything out with a single flush
+  out += '\n';
+  os.write(out.data(), static_cast<std::streamsize>(out.size()));
+  os.flush();
+}
@@ -0,0 +1,480 @@
+#include "common/simd.hpp"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ALTA_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace simd {
+
+/* -------------------------------------------------------------------------- */
+/* RUNTIME DISPATCH */
+/* -------------------------------------------------------------------------- */
+
+namespace {
+
+Level detect_level() {
+#ifdef ALTA_SIMD_X86
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    return Level::AVX2;
+  if (__builtin_cpu_supports("sse2"))
+    return Level::SSE2;
+#endif
+  return Level::Scalar;
+}
+
+Level supported_level() {
+  static const Level cached = detect_level();
+  return cached;
+}
+
+std::atomic<Level> &selected_level() {
+  static std::atomic<Level> selected = supported_level();
+  return selected;
+}
+
+[[maybe_unused]] Level level() {
+  return selected_level().load(std::memory_order_relaxed);
+}
+
+/* -------------------------------------------------------------------------- */
+/* SCALAR IMPLEMENTATIONS */
+/* -------------------------------------------------------------------------- */
+
+size_t count_byte_scalar(const char *data, size_t size, char byte) {
+  size_t count = 0;
+  for (size_t i = 0; i < size; ++i)
+    count += data[i] == byte;
+  return count;
+}
+
+uint32_t *find_all_scalar(const char *data, size_t size, char byte,
+                          uint32_t base, uint32_t *out) {
+  for (size_t i = 0; i < size; ++i) {
+    if (data[i] == byte)
+      *out++ = base + static_cast<uint32_t>(i);
+  }
+  return out;
+}
+
+/// Returns the length of the valid multi-byte UTF-8 sequence starting at
+/// `data[i]`, or `0` if there isn't one.
+size_t sequence_length(const unsigned char *data, size_t size, size_t i) {
+  const auto lead = data[i];
+  size_t length = 0;
+  uint32_t codepoint = 0;
+  uint32_t minimum = 0;
+  if ((lead & 0xE0) == 0xC0) {
+    length = 2, codepoint = lead & 0x1F, minimum = 0x80;
+  } else if ((lead & 0xF0) == 0xE0) {
+    length = 3, codepoint = lead & 0x0F, minimum = 0x800;
+  } else if ((lead & 0xF8) == 0xF0) {
+    length = 4, codepoint = lead & 0x07, minimum = 0x10000;
+  } else {
+    return 0;
+  }
+
+  if (length > size - i)
+    return 0;
+  for (size_t k = 1; k < length; ++k) {
+    const auto cont = data[i + k];
+    if ((cont & 0xC0) != 0x80)
+      return 0;
+    codepoint = (codepoint << 6) | (cont & 0x3F);
+  }
+
+  // Overlong encodings, surrogates and anything past the last codepoint
+  if (codepoint < minimum || codepoint > 0x10FFFF ||
+      (codepoint >= 0xD800 && codepoint <= 0xDFFF))
+    return 0;
+  return length;
+}
+
+/// Validates UTF-8 one sequence at a time, starting from `i`, which must be the
+/// start of a sequence.
+Utf8Check check_utf8_scalar(const char *data, size_t size, size_t i,
+                            bool ascii) {
+  const auto *bytes = reinterpret_cast<const unsigned char *>(data);
+  while (i < size) {
+    if (bytes[i] < 0x80) {
+      ++i;
+      continue;
+    }
+    ascii = false;
+    const auto length = sequence_length(bytes, size, i);
+    if (length == 0)
+      return {i, false};
+    i += length;
+  }
+  return {size, ascii};
+}
+
+size_t count_codepoints_scalar(const char *data, size_t size) {
+  size_t count = 0;
+  for (size_t i = 0; i < size; ++i)
+    count += (static_cast<unsigned char>(data[i]) & 0xC0) != 0x80;
+  return count;
+}
+
+/// Backs up from `i` to the start of the UTF-8 sequence containing it, looking
+/// no further than a sequence can be long.
+size_t sequence_start(const char *data, size_t i) {
+  for (int k = 0; k < 3 && i > 0; ++k) {
+    if ((static_cast<unsigned char>(data[i]) & 0xC0) != 0x80)
+      break;
+    --i;
+  }
+  return i;
+}
+
+/* -------------------------------------------------------------------------- */
+/* X86 IMPLEMENTATIONS */
+/* -------------------------------------------------------------------------- */
+
+#ifdef ALTA_SIMD_X86
+
+__attribute__((target("sse2"))) size_t
+count_byte_sse2(const char *data, size_t size, char byte) {
+  const __m128i needle = _mm_set1_epi8(byte);
+  size_t count = 0;
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    const __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    const auto mask =
+        static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)));
+    count += std::popcount(mask);
+  }
+  return count + count_byte_scalar(data + i, size - i, byte);
+}
+
+__attribute__((target("avx2"))) size_t
+count_byte_avx2(const char *data, size_t size, char byte) {
+  const __m256i needle = _mm256_set1_epi8(byte);
+  size_t count = 0;
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    const __m256i block =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+    const auto mask = static_cast<uint32_t>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle)));
+    count += std::popcount(mask);
+  }
+  return count + count_byte_scalar(data + i, size - i, byte);
+}
+
+__attribute__((target("sse2"))) void
+find_all_sse2(const char *data, size_t size, char byte, uint32_t *out) {
+  const __m128i needle = _mm_set1_epi8(byte);
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    const __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    auto mask =
+        static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(block, needle)));
+    while (mask != 0) {
+      *out++ = static_cast<uint32_t>(i) + std::countr_zero(mask);
+      mask &= mask - 1;
+    }
+  }
+  find_all_scalar(data + i, size - i, byte, static_cast<uint32_t>(i), out);
+}
+
+__attribute__((target("avx2"))) void
+find_all_avx2(const char *data, size_t size, char byte, uint32_t *out) {
+  const __m256i needle = _mm256_set1_epi8(byte);
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    const __m256i block =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+    auto mask = static_cast<uint32_t>(
+        _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, needle)));
+    while (mask != 0) {
+      *out++ = static_cast<uint32_t>(i) + std::countr_zero(mask);
+      mask &= mask - 1;
+    }
+  }
+  find_all_scalar(data + i, size - i, byte, static_cast<uint32_t>(i), out);
+}
+
+/// Skips ASCII 16 bytes at a time and validates everything else one sequence
+/// at a time. Used where AVX2 isn't available.
+__attribute__((target("sse2"))) Utf8Check check_utf8_sse2(const char *data,
+                                                          size_t size) {
+  const auto *bytes = reinterpret_cast<const unsigned char *>(data);
+  bool ascii = true;
+  size_t i = 0;
+  while (i < size) {
+    if (i + 16 <= size) {
+      const __m128i block =
+          _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+      if (_mm_movemask_epi8(block) == 0) {
+        i += 16;
+        continue;
+      }
+    }
+    if (bytes[i] < 0x80) {
+      ++i;
+      continue;
+    }
+
+    ascii = false;
+    const auto length = sequence_length(bytes, size, i);
+    if (length == 0)
+      return {i, false};
+    i += length;
+  }
+  return {size, ascii};
+}
+
+/* Error classes for a pair of adjacent bytes in the UTF-8 lookup validator,
+ * named after the problem they reveal. */
+constexpr uint8_t TOO_SHORT = 1 << 0;  // 11______ 0_______, 11______ 11______
+constexpr uint8_t TOO_LONG = 1 << 1;   // 0_______ 10______
+constexpr uint8_t OVERLONG_3 = 1 << 2; // 11100000 100_____
+constexpr uint8_t TOO_LARGE = 1 << 3;  // 11110100 1001____, 11110100 101_____
+constexpr uint8_t SURROGATE = 1 << 4;  // 11101101 101_____
+constexpr uint8_t OVERLONG_2 = 1 << 5; // 1100000_ 10______
+constexpr uint8_t TOO_LARGE_1000 = 1 << 6; // 11110101 1000____
+constexpr uint8_t OVERLONG_4 = 1 << 6;     // 11110000 1000____
+constexpr uint8_t TWO_CONTS = 1 << 7;      // 10______ 10______
+constexpr uint8_t CARRY = TOO_SHORT | TOO_LONG | TWO_CONTS;
+constexpr uint8_t LARGE = CARRY | TOO_LARGE | TOO_LARGE_1000;
+
+/// Error classes keyed by the high nibble of the first byte of a pair.
+constexpr uint8_t BYTE_1_HIGH[16] = {
+    TOO_LONG,  TOO_LONG,  TOO_LONG,  TOO_LONG,
+    TOO_LONG,  TOO_LONG,  TOO_LONG,  TOO_LONG,
+    TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+    TOO_SHORT | OVERLONG_2,
+    TOO_SHORT,
+    TOO_SHORT | OVERLONG_3 | SURROGATE,
+    TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4,
+};
+
+/// Error classes keyed by the low nibble of the first byte of a pair.
+constexpr uint8_t BYTE_1_LOW[16] = {
+    CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+    CARRY | OVERLONG_2,
+    CARRY,
+    CARRY,
+    CARRY | TOO_LARGE,
+    LARGE, LARGE, LARGE, LARGE, LARGE, LARGE, LARGE, LARGE,
+    LARGE | SURROGATE,
+    LARGE, LARGE,
+};
+
+/// Error classes keyed by the high nibble of the second byte of a pair.
+constexpr uint8_t BYTE_2_HIGH[16] = {
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 |
+        OVERLONG_4,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+    TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+};
+
+/// Looks each byte of `index` (all below 16) up in the 16-entry `table`.
+__attribute__((target("avx2"))) __m256i lookup16(const uint8_t (&table)[16],
+                                                 __m256i index) {
+  const __m256i entries = _mm256_broadcastsi128_si256(
+      _mm_loadu_si128(reinterpret_cast<const __m128i *>(table)));
+  return _mm256_shuffle_epi8(entries, index);
+}
+
+__attribute__((target("avx2"))) __m256i high_nibbles(__m256i v) {
+  return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+}
+
+/// Validates 32 bytes at a time with the lookup algorithm of Keiser and Lemire
+/// ("Validating UTF-8 in less than one instruction per byte"). The three
+/// tables above classify each pair of adjacent bytes, and any error bit that
+/// survives ANDing the classes flags an invalid pair. Longer sequences are
+/// checked by requiring continuation bytes exactly where a three or four byte
+/// lead says they should be.
+__attribute__((target("avx2"))) Utf8Check check_utf8_avx2(const char *data,
+                                                          size_t size) {
+  // A block ending in the first byte of a sequence of length n is incomplete
+  // if any of its last n - 1 bytes exceed these
+  const __m256i incomplete_limit = _mm256_setr_epi8(
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, static_cast<char>(0xF0 - 1),
+      static_cast<char>(0xE0 - 1), static_cast<char>(0xC0 - 1));
+  const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+
+  __m256i prev_input = _mm256_setzero_si256();
+  __m256i prev_incomplete = _mm256_setzero_si256();
+  bool ascii = true;
+
+  for (size_t i = 0; i < size; i += 32) {
+    __m256i input;
+    if (i + 32 <= size) {
+      input = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+    } else {
+      // Zeros are ASCII, so padding the last block can't hide an error
+      alignas(32) char tail[32] = {};
+      std::memcpy(tail, data + i, size - i);
+      input = _mm256_load_si256(reinterpret_cast<const __m256i *>(tail));
+    }
+
+    __m256i error;
+    if (_mm256_movemask_epi8(input) == 0) {
+      error = prev_incomplete;
+      prev_incomplete = _mm256_setzero_si256();
+    } else {
+      ascii = false;
+
+      // The input shifted right by 1, 2 and 3 bytes, carrying in the end of
+      // the previous block
+      const __m256i carried =
+          _mm256_permute2x128_si256(prev_input, input, 0x21);
+      const __m256i prev1 = _mm256_alignr_epi8(input, carried, 15);
+      const __m256i prev2 = _mm256_alignr_epi8(input, carried, 14);
+      const __m256i prev3 = _mm256_alignr_epi8(input, carried, 13);
+
+      const __m256i special = _mm256_and_si256(
+          _mm256_and_si256(
+              lookup16(BYTE_1_HIGH, high_nibbles(prev1)),
+              lookup16(BYTE_1_LOW, _mm256_and_si256(prev1, low_nibble))),
+          lookup16(BYTE_2_HIGH, high_nibbles(input)));
+
+      // Bytes two and three past a 3 or 4 byte lead must be continuations
+      const __m256i third =
+          _mm256_subs_epu8(prev2, _mm256_set1_epi8(0xE0 - 0x80));
+      const __m256i fourth =
+          _mm256_subs_epu8(prev3, _mm256_set1_epi8(0xF0 - 0x80));
+      const __m256i must_continue = _mm256_and_si256(
+          _mm256_or_si256(third, fourth), _mm256_set1_epi8(char(0x80)));
+
+      error = _mm256_xor_si256(must_continue, special);
+      prev_incomplete = _mm256_subs_epu8(input, incomplete_limit);
+    }
+    prev_input = input;
+
+    // Find exactly where it went wrong, the error may have started at the
+    // end of the previous block
+    if (!_mm256_testz_si256(error, error)) {
+      const auto from = sequence_start(data, i >= 32 ? i - 32 : 0);
+      return check_utf8_scalar(data, size, from, false);
+    }
+  }
+
+  if (!_mm256_testz_si256(prev_incomplete, prev_incomplete)) {
+    const auto from = sequence_start(data, size >= 32 ? size - 32 : 0);
+    return check_utf8_scalar(data, size, from, false);
+  }
+  return {size, ascii};
+}
+
+__attribute__((target("sse2"))) size_t count_codepoints_sse2(const char *data,
+                                                             size_t size) {
+  // Continuation bytes are 0x80-0xBF, which are the signed bytes below -64
+  const __m128i limit = _mm_set1_epi8(-65);
+  size_t count = 0;
+  size_t i = 0;
+  for (; i + 16 <= size; i += 16) {
+    const __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    const auto mask =
+        static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpgt_epi8(block, limit)));
+    count += std::popcount(mask);
+  }
+  return count + count_codepoints_scalar(data + i, size - i);
+}
+
+__attribute__((target("avx2"))) size_t count_codepoints_avx2(const char *data,
+                                                             size_t size) {
+  const __m256i limit = _mm256_set1_epi8(-65);
+  size_t count = 0;
+  size_t i = 0;
+  for (; i + 32 <= size; i += 32) {
+    const __m256i block =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+    const auto mask = static_cast<uint32_t>(
+        _mm256_movemask_epi8(_mm256_cmpgt_epi8(block, limit)));
+    count += std::popcount(mask);
+  }
+  return count + count_codepoints_scalar(data + i, size - i);
+}
+
+#endif
+
+} // namespace
+
+/* -------------------------------------------------------------------------- */
+/* PUBLIC ENTRY POINTS */
+/* -------------------------------------------------------------------------- */
+
+Level active_level() { return level(); }
+
+void set_level(Level requested) {
+  selected_level().store(std::min(requested, supported_level()),
+                         std::memory_order_relaxed);
+}
+
+size_t count_byte(const char *data, size_t size, char byte) {
+#ifdef ALTA_SIMD_X86
+  switch (level()) {
+  case Level::AVX2:
+    return count_byte_avx2(data, size, byte);
+  case Level::SSE2:
+    return count_byte_sse2(data, size, byte);
+  default:
+    break;
+  }
+#endif
+  return count_byte_scalar(data, size, byte);
+}
+
+void find_all(const char *data, size_t size, char byte, uint32_t *out) {
+#ifdef ALTA_SIMD_X86
+  switch (level()) {
+  case Level::AVX2:
+    return find_all_avx2(data, size, byte, out);
+  case Level::SSE2:
+    return find_all_sse2(data, size, byte, out);
+  default:
+    break;
+  }
+#endif
+  find_all_scalar(data, size, byte, 0, out);
+}
+
+Utf8Check check_utf8(const char *data, size_t size) {
+#ifdef ALTA_SIMD_X86
+  switch (level()) {
+  case Level::AVX2:
+    return check_utf8_avx2(data, size);
+  case Level::SSE2:
+    return check_utf8_sse2(data, size);
+  default:
+    break;
+  }
+#endif
+  return check_utf8_scalar(data, size, 0, true);
+}
+
+size_t count_codepoints(const char *data, size_t size) {
+#ifdef ALTA_SIMD_X86
+  switch (level()) {
+  case Level::AVX2:
+    return count_codepoints_avx2(data, size);
+  case Level::SSE2:
+    return count_codepoints_sse2(data, size);
+  default:
+    break;
+  }
+#endif
+  return count_codepoints_scalar(data, size);
+}
+
+}; // namespace simd
@@ -0,0 +1,515 @@
+#include "common/source_loader.hpp"
+#include "common/span.hpp"
+#include "common/thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <initializer_list>
+#include <limits>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#if __has_include(<unistd.h>)
+#define ALTA_HAVE_PREAD 1
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define ALTA_HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* IMPLEMENTATION-PRIVATE HELPERS */
+/* -------------------------------------------------------------------------- */
+
+namespace {
+
+std::error_code errno_code(int error) {
+  return std::error_code(error, std::generic_category());
+}
+
+/// Allocates the buffer a file of `size` bytes is read into, with room for the
+/// padding `Source` appends so that handing it over never reallocates.
+std::string make_buffer(size_t size) {
+  std::string buffer;
+  buffer.reserve(size + SOURCE_PADDING);
+  buffer.resize(size);
+  return buffer;
+}
+
+/// Reads one file synchronously with `pread`, for the thread pool backend.
+SourceLoader::Result read_file(const std::string &path) {
+#ifdef ALTA_HAVE_PREAD
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return std::unexpected(errno_code(errno));
+
+  struct stat info {};
+  if (fstat(fd, &info) != 0) {
+    const auto error = errno_code(errno);
+    close(fd);
+    return std::unexpected(error);
+  }
+  const auto size = static_cast<size_t>(info.st_size);
+  if (size > std::numeric_limits<uint32_t>::max()) {
+    close(fd);
+    return std::unexpected(std::make_error_code(std::errc::file_too_large));
+  }
+
+  auto buffer = make_buffer(size);
+  size_t done = 0;
+  while (done < size) {
+    const auto n = pread(fd, buffer.data() + done, size - done,
+                         static_cast<off_t>(done));
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0) {
+      const auto error = errno_code(errno);
+      close(fd);
+      return std::unexpected(error);
+    }
+    // The file shrank since we measured it
+    if (n == 0) {
+      buffer.resize(done);
+      break;
+    }
+    done += static_cast<size_t>(n);
+  }
+  close(fd);
+  return std::make_unique<Source>(std::move(buffer), path);
+#else
+  return Source::map(path);
+#endif
+}
+
+/* -------------------------------------------------------------------------- */
+/* IO_URING */
+/* -------------------------------------------------------------------------- */
+
+#ifdef ALTA_HAVE_IO_URING
+
+/// A minimal io_uring: the submission and completion rings mapped from the
+/// kernel, without any of liburing's conveniences.
+class Ring {
+  int fd = -1;
+  io_uring_params params{};
+
+  void *sq_ring = MAP_FAILED;
+  size_t sq_ring_size = 0;
+  void *cq_ring = MAP_FAILED;
+  size_t cq_ring_size = 0;
+  io_uring_sqe *sqes = static_cast<io_uring_sqe *>(MAP_FAILED);
+
+  unsigned *sq_tail = nullptr;
+  unsigned *sq_array = nullptr;
+  unsigned *cq_head = nullptr;
+  unsigned *cq_tail = nullptr;
+  io_uring_cqe *cqes = nullptr;
+
+  /// Entries pushed since the last `submit_and_wait()`.
+  unsigned pending = 0;
+
+  /// Entries the kernel didn't take when it last refused a submission.
+  unsigned refused = 0;
+
+  template <typename T> T *at(void *ring, unsigned offset) {
+    return reinterpret_cast<T *>(static_cast<char *>(ring) + offset);
+  }
+
+public:
+  explicit Ring(unsigned entries) {
+    fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+    if (fd < 0)
+      return;
+
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size =
+        params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    const bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single)
+      sq_ring_size = cq_ring_size = std::max(sq_ring_size, cq_ring_size);
+
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    cq_ring = single ? sq_ring
+                     : mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    sqes = static_cast<io_uring_sqe *>(
+        mmap(nullptr, params.sq_entries * sizeof(io_uring_sqe),
+             PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+             IORING_OFF_SQES));
+    if (sq_ring == MAP_FAILED || cq_ring == MAP_FAILED || sqes == MAP_FAILED)
+      return;
+
+    sq_tail = at<unsigned>(sq_ring, params.sq_off.tail);
+    sq_array = at<unsigned>(sq_ring, params.sq_off.array);
+    cq_head = at<unsigned>(cq_ring, params.cq_off.head);
+    cq_tail = at<unsigned>(cq_ring, params.cq_off.tail);
+    cqes = at<io_uring_cqe>(cq_ring, params.cq_off.cqes);
+  }
+
+  ~Ring() {
+    if (sqes != MAP_FAILED)
+      munmap(sqes, params.sq_entries * sizeof(io_uring_sqe));
+    if (cq_ring != MAP_FAILED && cq_ring != sq_ring)
+      munmap(cq_ring, cq_ring_size);
+    if (sq_ring != MAP_FAILED)
+      munmap(sq_ring, sq_ring_size);
+    if (fd >= 0)
+      close(fd);
+  }
+
+  Ring(const Ring &) = delete;
+  Ring &operator=(const Ring &) = delete;
+
+  [[nodiscard]] bool valid() const { return cqes != nullptr; }
+
+  /// Returns the number of entries in the submission queue. The completion
+  /// queue is twice as large.
+  [[nodiscard]] unsigned capacity() const { return params.sq_entries; }
+
+  /// Returns whether the kernel implements every opcode in `ops`.
+  bool supports(std::initializer_list<uint8_t> ops) {
+    constexpr size_t OPS = 256;
+    std::vector<char> storage(sizeof(io_uring_probe) +
+                              OPS * sizeof(io_uring_probe_op));
+    auto *probe = reinterpret_cast<io_uring_probe *>(storage.data());
+    if (syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe,
+                OPS) < 0)
+      return false;
+
+    for (const auto op : ops) {
+      if (op > probe->last_op ||
+          (probe->ops[op].flags & IO_URING_OP_SUPPORTED) == 0)
+        return false;
+    }
+    return true;
+  }
+
+  /// Returns a zeroed submission entry to fill in. The caller must push no
+  /// more than `capacity()` entries between submissions.
+  io_uring_sqe &push() {
+    const unsigned mask = *at<unsigned>(sq_ring, params.sq_off.ring_mask);
+    const unsigned index = (*sq_tail + pending) & mask;
+    sq_array[index] = index;
+    ++pending;
+    auto &sqe = sqes[index];
+    std::memset(&sqe, 0, sizeof(sqe));
+    return sqe;
+  }
+
+  /// Publishes every entry pushed since the last call and blocks until the
+  /// kernel took all of them and at least one completion is available.
+  /// Returns `false` if the kernel refused the submission, leaving the entries
+  /// it didn't take to `for_each_refused()`.
+  bool submit_and_wait() {
+    std::atomic_ref<unsigned>(*sq_tail).store(*sq_tail + pending,
+                                              std::memory_order_release);
+    unsigned left = pending;
+    pending = 0;
+
+    // The kernel may take fewer entries than it was given, and then returns
+    // without waiting, so it is asked again for the rest. A wait interrupted
+    // after everything was taken returns early, and the caller calls again
+    do {
+      const auto taken = syscall(__NR_io_uring_enter, fd, left, 1,
+                                 IORING_ENTER_GETEVENTS, nullptr, 0);
+      if (taken < 0 && (errno == EINTR || errno == EAGAIN))
+        continue;
+      // Nothing taken means the rest was dropped, and never will be
+      if (taken < 0 || (taken == 0 && left > 0)) {
+        refused = left;
+        return false;
+      }
+      left -= static_cast<unsigned>(taken);
+    } while (left > 0);
+    return true;
+  }
+
+  /// Calls `handle` on every entry the kernel didn't take when it last
+  /// refused a submission. They will never complete.
+  template <typename F> void for_each_refused(F &&handle) {
+    const unsigned mask = *at<unsigned>(sq_ring, params.sq_off.ring_mask);
+    for (unsigned i = *sq_tail - refused; i != *sq_tail; ++i)
+      handle(sqes[sq_array[i & mask]]);
+  }
+
+  /// Returns how many entries the kernel didn't take when it last refused a
+  /// submission.
+  [[nodiscard]] unsigned refused_count() const { return refused; }
+
+  /// Blocks until `count` more completions arrived, calling `handle` on each,
+  /// unless the kernel refuses to wait.
+  template <typename F> void wait(unsigned count, F &&handle) {
+    while (count > 0) {
+      if (syscall(__NR_io_uring_enter, fd, 0, 1, IORING_ENTER_GETEVENTS,
+                  nullptr, 0) < 0 &&
+          errno != EINTR && errno != EAGAIN)
+        return;
+      reap([&](const io_uring_cqe &cqe) {
+        handle(cqe);
+        --count;
+      });
+    }
+  }
+
+  /// Calls `handle` on every completion currently in the queue.
+  template <typename F> void reap(F &&handle) {
+    unsigned head = *cq_head;
+    const unsigned tail =
+        std::atomic_ref<unsigned>(*cq_tail).load(std::memory_order_acquire);
+    const unsigned mask = *at<unsigned>(cq_ring, params.cq_off.ring_mask);
+    for (; head != tail; ++head)
+      handle(cqes[head & mask]);
+    std::atomic_ref<unsigned>(*cq_head).store(head, std::memory_order_release);
+  }
+};
+
+/// Size of the ring used for loading, and so the number of files in flight.
+constexpr unsigned RING_ENTRIES = 256;
+
+/// The operations that make up loading one file, tagged into `user_data`.
+enum class Op : uint64_t { Open, Stat, Read, Close };
+
+uint64_t tag(size_t slot, Op op) {
+  return (static_cast<uint64_t>(slot) << 2) | static_cast<uint64_t>(op);
+}
+
+/// One file being loaded through the ring.
+struct Pending {
+  bool busy = false;
+  size_t index = 0;
+  int fd = -1;
+  int error = 0;
+  unsigned waiting = 0;
+  struct statx stat {};
+  std::string buffer;
+  size_t read = 0;
+};
+
+bool io_uring_supported() {
+  static const bool supported = [] {
+    Ring ring(8);
+    return ring.valid() &&
+           ring.supports({IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ,
+                          IORING_OP_CLOSE});
+  }();
+  return supported;
+}
+
+#endif
+
+} // namespace
+
+/* -------------------------------------------------------------------------- */
+/* LOADER IMPLEMENTATION */
+/* -------------------------------------------------------------------------- */
+
+SourceLoader::SourceLoader(unsigned threads)
+    : SourceLoader(Backend::IoUring, threads) {}
+
+SourceLoader::SourceLoader(Backend backend, unsigned threads)
+    : backend(backend), threads(threads) {
+#ifdef ALTA_HAVE_IO_URING
+  if (backend == Backend::IoUring && !io_uring_supported())
+    this->backend = Backend::ThreadPool;
+#else
+  this->backend = Backend::ThreadPool;
+#endif
+}
+
+SourceLoader::Backend SourceLoader::get_backend() const { return backend; }
+
+void SourceLoader::load(const std::vector<std::string> &paths,
+                        const Callback &on_loaded) const {
+  if (backend == Backend::IoUring)
+    load_io_uring(paths, on_loaded);
+  else
+    load_thread_pool(paths, on_loaded);
+}
+
+void SourceLoader::load_thread_pool(const std::vector<std::string> &paths,
+                                    const Callback &on_loaded) const {
+  ThreadPool pool(threads);
+  pool.run(paths.size(),
+           [&](size_t i) { on_loaded(i, read_file(paths[i])); });
+}
+
+void SourceLoader::load_io_uring(const std::vector<std::string> &paths,
+                                 const Callback &on_loaded) const {
+#ifdef ALTA_HAVE_IO_URING
+  Ring ring(RING_ENTRIES);
+  if (!ring.valid())
+    return load_thread_pool(paths, on_loaded);
+
+  // A file has up to two operations in flight (open and stat) plus the close
+  // of whichever file held its slot before, and one round can queue a close
+  // and a fresh open and stat for every slot. A quarter of the ring per slot
+  // keeps both the submission and completion queues from overflowing.
+  std::vector<Pending> slots(ring.capacity() / 4);
+  std::vector<size_t> free_slots;
+  for (size_t i = slots.size(); i > 0; --i)
+    free_slots.push_back(i - 1);
+
+  size_t next = 0;
+  size_t delivered = 0;
+  unsigned inflight = 0;
+
+  // Starts loading `paths[index]`: open it and query its size side by side
+  const auto start = [&](size_t index) {
+    const auto slot = free_slots.back();
+    free_slots.pop_back();
+    auto &file = slots[slot];
+    file = Pending{};
+    file.busy = true;
+    file.index = index;
+    file.waiting = 2;
+
+    auto &open = ring.push();
+    open.opcode = IORING_OP_OPENAT;
+    open.fd = AT_FDCWD;
+    open.addr = reinterpret_cast<uint64_t>(paths[index].c_str());
+    open.open_flags = O_RDONLY | O_CLOEXEC;
+    open.user_data = tag(slot, Op::Open);
+
+    auto &stat = ring.push();
+    stat.opcode = IORING_OP_STATX;
+    stat.fd = AT_FDCWD;
+    stat.addr = reinterpret_cast<uint64_t>(paths[index].c_str());
+    stat.len = STATX_SIZE;
+    stat.off = reinterpret_cast<uint64_t>(&file.stat);
+    stat.user_data = tag(slot, Op::Stat);
+    inflight += 2;
+  };
+
+  const auto read_more = [&](size_t slot) {
+    auto &file = slots[slot];
+    auto &read = ring.push();
+    read.opcode = IORING_OP_READ;
+    read.fd = file.fd;
+    read.addr = reinterpret_cast<uint64_t>(file.buffer.data() + file.read);
+    read.len = static_cast<uint32_t>(file.buffer.size() - file.read);
+    read.off = file.read;
+    read.user_data = tag(slot, Op::Read);
+    ++inflight;
+  };
+
+  // Hands the file's result out and recycles its slot, closing the file
+  // asynchronously if it was opened
+  const auto finish = [&](size_t slot) {
+    auto &file = slots[slot];
+    if (file.fd >= 0) {
+      auto &close = ring.push();
+      close.opcode = IORING_OP_CLOSE;
+      close.fd = file.fd;
+      close.user_data = tag(slot, Op::Close);
+      ++inflight;
+    }
+
+    const auto index = file.index;
+    if (file.error != 0) {
+      on_loaded(index, std::unexpected(errno_code(file.error)));
+    } else {
+      on_loaded(index, std::make_unique<Source>(std::move(file.buffer),
+                                                paths[index]));
+    }
+    file.busy = false;
+    free_slots.push_back(slot);
+    ++delivered;
+  };
+
+  const auto handle = [&](const io_uring_cqe &cqe) {
+    --inflight;
+    const auto op = static_cast<Op>(cqe.user_data & 3);
+    const auto slot = static_cast<size_t>(cqe.user_data >> 2);
+    auto &file = slots[slot];
+
+    switch (op) {
+    case Op::Open:
+    case Op::Stat: {
+      if (cqe.res < 0)
+        file.error = -cqe.res;
+      else if (op == Op::Open)
+        file.fd = cqe.res;
+
+      if (--file.waiting > 0)
+        return;
+      if (file.error == 0 &&
+          file.stat.stx_size > std::numeric_limits<uint32_t>::max())
+        file.error = EFBIG;
+      if (file.error != 0 || file.stat.stx_size == 0)
+        return finish(slot);
+
+      file.buffer = make_buffer(static_cast<size_t>(file.stat.stx_size));
+      return read_more(slot);
+    }
+    case Op::Read: {
+      if (cqe.res == -EINTR || cqe.res == -EAGAIN)
+        return read_more(slot);
+      if (cqe.res < 0) {
+        file.error = -cqe.res;
+        return finish(slot);
+      }
+
+      // A zero-length read means the file shrank since it was measured
+      if (cqe.res == 0)
+        file.buffer.resize(file.read);
+      file.read += static_cast<size_t>(cqe.res);
+      if (file.read < file.buffer.size())
+        return read_more(slot);
+      return finish(slot);
+    }
+    case Op::Close:
+      return;
+    }
+  };
+
+  while (delivered < paths.size() || inflight > 0) {
+    while (next < paths.size() && !free_slots.empty())
+      start(next++);
+
+    if (!ring.submit_and_wait()) {
+      // Whatever the kernel took may still be opening a file or reading into
+      // a slot's buffer, so it is waited for before any file is closed or its
+      // buffer dropped. Closes it never took are done here instead
+      ring.for_each_refused([](const io_uring_sqe &sqe) {
+        if (sqe.opcode == IORING_OP_CLOSE)
+          close(sqe.fd);
+      });
+      ring.wait(inflight - ring.refused_count(),
+                [&](const io_uring_cqe &cqe) {
+                  auto &file = slots[static_cast<size_t>(cqe.user_data >> 2)];
+                  if (static_cast<Op>(cqe.user_data & 3) == Op::Open &&
+                      cqe.res >= 0)
+                    file.fd = cqe.res;
+                });
+
+      // Load whatever is left synchronously rather than give up on it
+      for (const auto &file : slots) {
+        if (!file.busy)
+          continue;
+        if (file.fd >= 0)
+          close(file.fd);
+        on_loaded(file.index, read_file(paths[file.index]));
+      }
+      for (; next < paths.size(); ++next)
+        on_loaded(next, read_file(paths[next]));
+      return;
+    }
+    ring.reap(handle);
+  }
+#else
+  load_thread_pool(paths, on_loaded);
+#endif
+}
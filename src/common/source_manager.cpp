@@ -0,0 +1,98 @@
+#include "common/source_manager.hpp"
+#include "common/span.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <utility>
+#include <vector>
+
+SourceManager &SourceManager::global() {
+  static SourceManager manager;
+  return manager;
+}
+
+std::optional<std::pair<uint64_t, std::vector<SourceManager::Entry>::iterator>>
+SourceManager::fit(const uint64_t from, const uint64_t extent) {
+  // Start from the first range at or after `from`, unless the one before it
+  // still covers `from`
+  uint64_t base = from;
+  auto it = std::lower_bound(
+      entries.begin(), entries.end(), from,
+      [](const Entry &entry, const uint64_t value) {
+        return entry.base < value;
+      });
+  if (it != entries.begin())
+    base = std::max(base, static_cast<uint64_t>((it - 1)->base) +
+                              (it - 1)->extent);
+
+  // Then try each gap between ranges, ending with the space after the last
+  for (; it != entries.end(); ++it) {
+    if (it->base >= base + extent)
+      break;
+    base = static_cast<uint64_t>(it->base) + it->extent;
+  }
+
+  if (base + extent > std::numeric_limits<uint32_t>::max())
+    return std::nullopt;
+  return std::pair(base, it);
+}
+
+uint32_t SourceManager::add(const Source &source) {
+  // One extra offset so the EOF position of the source is addressable
+  const uint64_t extent = static_cast<uint64_t>(source.size) + 1;
+  const std::unique_lock guard(lock);
+
+  // Next-fit: carry on from the last range handed out, and only go back to
+  // the start of the space for ranges freed since once the end is reached
+  auto found = fit(next, extent);
+  if (!found.has_value())
+    found = fit(0, extent);
+  if (!found.has_value()) {
+    std::fprintf(stderr, "fatal: out of source offset space loading `%s`\n",
+                 source.path.c_str());
+    std::abort();
+  }
+
+  const auto [base, it] = found.value();
+  entries.insert(it, Entry{static_cast<uint32_t>(base),
+                           static_cast<uint32_t>(extent), &source});
+  next = base + extent;
+  return static_cast<uint32_t>(base);
+}
+
+void SourceManager::remove(const Source &source) {
+  const std::unique_lock guard(lock);
+  const auto it =
+      std::find_if(entries.begin(), entries.end(),
+                   [&](const Entry &entry) { return entry.source == &source; });
+  if (it != entries.end())
+    entries.erase(it);
+}
+
+const Source *SourceManager::find(const uint32_t offset) const {
+  const std::shared_lock guard(lock);
+
+  // The entry before the first one starting past `offset` is the candidate
+  const auto next = std::upper_bound(
+      entries.begin(), entries.end(), offset,
+      [](const uint32_t value, const Entry &entry) {
+        return value < entry.base;
+      });
+  if (next == entries.begin())
+    return nullptr;
+
+  const auto &entry = *(next - 1);
+  if (offset - entry.base >= entry.extent)
+    return nullptr;
+  return entry.source;
+}
+
+size_t SourceManager::size() const {
+  const std::shared_lock guard(lock);
+  return entries.size();
+}
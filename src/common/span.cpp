@@ -1,95 +1,269 @@
 #include "common/span.hpp"
+#include "common/simd.hpp"
+#include "common/source_manager.hpp"
+#include <algorithm>
 #include <cassert>
+#include <cstdint>
+#include <expected>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <memory>
 #include <optional>
 #include <string>
 #include <string_view>
+#include <system_error>
 #include <utility>
+#include <vector>
+
+#if __has_include(<sys/mman.h>)
+#define ALTA_HAVE_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* IMPLEMENTATION-PRIVATE HELPERS */
+/* -------------------------------------------------------------------------- */
+
+/// Builds the line-start table for `content`. Newlines are counted first so
+/// the table is allocated exactly once at its final size.
+std::vector<uint32_t> index_line_starts(const std::string_view &content) {
+  const auto newlines = simd::count_byte(content.data(), content.size(), '\n');
+  std::vector<uint32_t> starts(newlines + 1);
+  starts[0] = 0;
+  simd::find_all(content.data(), content.size(), '\n', starts.data() + 1);
+
+  // Each line begins one byte past the newline that ends the previous one
+  for (size_t i = 1; i < starts.size(); ++i)
+    ++starts[i];
+  return starts;
+}
+
+/// Appends the `SOURCE_PADDING` sentinel bytes to an owned source string.
+std::string pad(std::string content) {
+  content.append(SOURCE_PADDING, '\0');
+  return content;
+}
+
+#ifndef ALTA_HAVE_MMAP
+/// Reads the whole file at `path` into a string, for when it can't be mapped.
+std::expected<std::string, std::error_code> read_file(const std::string &path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file)
+    return std::unexpected(std::make_error_code(std::errc::io_error));
+  return std::string(std::istreambuf_iterator<char>(file), {});
+}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* SOURCE IMPLEMENTATION */
+/* -------------------------------------------------------------------------- */
 
 Source::Source(std::string content, std::string path)
-    : content(std::move(content)), path(std::move(path)),
-      size(this->content.size()) {}
+    : storage(pad(std::move(content))), mapping(nullptr), mapping_size(0),
+      content(storage.data(), storage.size() - SOURCE_PADDING),
+      path(std::move(path)), size(this->content.size()),
+      line_starts(index_line_starts(this->content)),
+      base(SourceManager::global().add(*this)) {
+  check_encoding();
+}
 
-Source::Source(std::string content)
-    : content(std::move(content)), path("<static>"),
-      size(this->content.size()) {}
+Source::Source(std::string content) : Source(std::move(content), "<static>") {}
 
-Span::Span(const Source &source, size_t offset, size_t length)
-    : source(source), offset(offset), length(length) {}
+Source::Source(void *mapping, size_t mapping_size, size_t size,
+               std::string path)
+    : storage(), mapping(mapping), mapping_size(mapping_size),
+      content(static_cast<const char *>(mapping), size), path(std::move(path)),
+      size(size), line_starts(index_line_starts(this->content)),
+      base(SourceManager::global().add(*this)) {
+  check_encoding();
+}
 
-std::string_view Source::line(const size_t ln) const {
-  assert(ln > 0 && "Line numbers are 1-based");
+Source::~Source() {
+  SourceManager::global().remove(*this);
+#ifdef ALTA_HAVE_MMAP
+  if (mapping != nullptr)
+    munmap(mapping, mapping_size);
+#endif
+}
+
+std::expected<std::unique_ptr<Source>, std::error_code>
+Source::map(std::string path) {
+#ifdef ALTA_HAVE_MMAP
+  const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0)
+    return std::unexpected(std::error_code(errno, std::generic_category()));
 
-  size_t line = 1;
-  size_t start = 0;
-
-  // Find start of requested line
-  for (size_t i = 0; i < size; ++i) {
-    if (line == ln) {
-      start = i;
-      break;
-    }
-    if (content[i] == '\n')
-      ++line;
+  struct stat info {};
+  if (fstat(fd, &info) != 0) {
+    const std::error_code error(errno, std::generic_category());
+    close(fd);
+    return std::unexpected(error);
   }
+  const auto size = static_cast<size_t>(info.st_size);
 
-  // If ln is beyond the number of lines, return empty view
-  if (line < ln) {
-    return {};
+  // Offsets into a source are stored in 32 bits
+  if (size > std::numeric_limits<uint32_t>::max()) {
+    close(fd);
+    return std::unexpected(std::make_error_code(std::errc::file_too_large));
   }
 
-  // Find the end of the line (either '\n' or EOF)
-  size_t end = content.find('\n', start);
+  // Empty files can't be mapped, and there's nothing to save by doing so
+  if (size == 0) {
+    close(fd);
+    return std::unique_ptr<Source>(new Source("", std::move(path)));
+  }
 
-  if (end == std::string::npos) {
-    // No newline found: return to EOF (no newline at end)
-    return std::string_view(content.data() + start, size - start);
-  } else {
-    // Found a newline: include it in the view
-    return std::string_view(content.data() + start, (end - start) + 1);
+  // Reserve zeroed anonymous pages covering the file plus its padding, then map
+  // the file over the front of them. The bytes past EOF are then guaranteed to
+  // be '\0' and readable, even when the file is an exact multiple of the page
+  // size and a plain file mapping would fault on the padding.
+  const auto page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  const auto mapping_size = (size + SOURCE_PADDING + page - 1) / page * page;
+  void *mapping = mmap(nullptr, mapping_size, PROT_READ,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (mapping == MAP_FAILED) {
+    const std::error_code error(errno, std::generic_category());
+    close(fd);
+    return std::unexpected(error);
+  }
+  if (mmap(mapping, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) ==
+      MAP_FAILED) {
+    const std::error_code error(errno, std::generic_category());
+    munmap(mapping, mapping_size);
+    close(fd);
+    return std::unexpected(error);
   }
+  close(fd);
+
+  // The lexer and the line index both walk the file front to back
+  madvise(mapping, size, MADV_SEQUENTIAL);
+  return std::unique_ptr<Source>(
+      new Source(mapping, mapping_size, size, std::move(path)));
+#else
+  auto content = read_file(path);
+  if (!content.has_value())
+    return std::unexpected(content.error());
+  if (content->size() > std::numeric_limits<uint32_t>::max())
+    return std::unexpected(std::make_error_code(std::errc::file_too_large));
+  return std::unique_ptr<Source>(
+      new Source(std::move(content.value()), std::move(path)));
+#endif
 }
 
-std::optional<size_t> Span::line_number() const {
-  if (offset >= source.size)
-    return std::nullopt;
+void Source::check_encoding() {
+  const auto check = simd::check_utf8(content.data(), size);
+  if (check.error < size)
+    invalid_utf8 = static_cast<uint32_t>(check.error);
+  ascii = check.ascii;
+}
 
-  const std::string_view sv(source.content.data(), offset);
+std::string_view Source::line(const size_t ln) const {
+  assert(ln > 0 && "Line numbers are 1-based");
 
-  int line = 1;
-  for (const auto ch : sv) {
-    if (ch == '\n')
-      ++line;
-  }
+  // If ln is beyond the number of lines, return empty view
+  if (ln > line_starts.size())
+    return {};
 
-  return line;
+  // A line runs up to and including its newline, or to EOF for the last one
+  const size_t start = line_starts[ln - 1];
+  const size_t end = ln < line_starts.size() ? line_starts[ln] : size;
+  return std::string_view(content.data() + start, end - start);
 }
 
-std::optional<size_t> Span::column_number() const {
-  if (offset >= source.size || offset + length > source.size)
+size_t Source::line_of(const size_t offset) const {
+  // The first line start past `offset` is one ahead of the containing line
+  const auto next =
+      std::upper_bound(line_starts.begin(), line_starts.end(), offset);
+  return static_cast<size_t>(next - line_starts.begin());
+}
+
+size_t Source::line_start(const size_t ln) const {
+  assert(ln > 0 && ln <= line_starts.size() && "Line number out of range");
+  return line_starts[ln - 1];
+}
+
+size_t Source::column_of(const size_t offset) const {
+  const auto start = line_start(line_of(offset));
+  if (ascii)
+    return offset - start + 1;
+  return simd::count_codepoints(content.data() + start, offset - start) + 1;
+}
+
+/* -------------------------------------------------------------------------- */
+/* SPAN IMPLEMENTATION */
+/* -------------------------------------------------------------------------- */
+
+Span::Span(const Source &source, size_t offset, size_t length)
+    : offset(source.base + static_cast<uint32_t>(offset)),
+      length(static_cast<uint32_t>(length)) {
+  assert(offset <= source.size && "Span starts past the end of its source");
+}
+
+const Source *Span::source() const {
+  return SourceManager::global().find(offset);
+}
+
+std::optional<size_t> Span::line_number() const {
+  const auto *src = source();
+  if (src == nullptr)
     return std::nullopt;
+  return line_number(*src);
+}
 
-  const auto end_of_previous_line = source.content.rfind('\n', offset);
-  if (end_of_previous_line == std::string::npos)
-    return offset + 1;
-  return offset - end_of_previous_line;
+std::optional<size_t> Span::column_number() const {
+  const auto *src = source();
+  if (src == nullptr)
+    return std::nullopt;
+  return column_number(*src);
 }
 
 std::string_view Span::lexeme() const {
-  if (offset >= source.size || offset + length > source.size)
+  const auto *src = source();
+  if (src == nullptr)
     return {};
+  return lexeme(*src);
+}
+
+std::optional<size_t> Span::line_number(const Source &source) const {
+  // An offset before the source's base wraps around to past its end, so a
+  // span outside the source fails the same bounds check either way
+  const size_t local = offset - source.base;
+  if (local >= source.size)
+    return std::nullopt;
+  return source.line_of(local);
+}
 
-  return std::string_view(source.content.data() + offset, length);
+std::optional<size_t> Span::column_number(const Source &source) const {
+  const size_t local = offset - source.base;
+  if (local >= source.size || local + length > source.size)
+    return std::nullopt;
+  return source.column_of(local);
+}
+
+std::string_view Span::lexeme(const Source &source) const {
+  const size_t local = offset - source.base;
+  if (local >= source.size || local + length > source.size)
+    return {};
+  return source.content.substr(local, length);
 }
 
 std::ostream &operator<<(std::ostream &os, const Span &span) {
-  const auto maybe_y = span.line_number();
-  const auto maybe_x = span.column_number();
+  // The source is looked up once for the path, line and column
+  const auto *src = span.source();
+  if (src == nullptr)
+    return os << "<unknown>:<y?>:<x?>";
+
+  const auto maybe_y = span.line_number(*src);
+  const auto maybe_x = span.column_number(*src);
   const std::string y =
       maybe_y.has_value() ? std::to_string(maybe_y.value()) : "<y?>";
   const std::string x =
       maybe_x.has_value() ? std::to_string(maybe_x.value()) : "<x?>";
-
-  os << span.source.path << ":" << y << ":" << x;
+  os << src->path << ":" << y << ":" << x;
   return os;
 }
@@ -0,0 +1,33 @@
+#include "common/stream_source.hpp"
+#include <cerrno>
+#include <cstddef>
+#include <expected>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+#if __has_include(<unistd.h>)
+#include <unistd.h>
+#else
+#include <io.h>
+#endif
+
+StreamSource::StreamSource(int fd, std::string path, size_t chunk_size)
+    : fd(fd), buffer(chunk_size), finished(false), path(std::move(path)) {}
+
+std::expected<std::string_view, std::error_code> StreamSource::next() {
+  while (!finished) {
+    const auto n = read(fd, buffer.data(), buffer.size());
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n < 0)
+      return std::unexpected(std::error_code(errno, std::generic_category()));
+    if (n == 0)
+      finished = true;
+    return std::string_view(buffer.data(), static_cast<size_t>(n));
+  }
+  return std::string_view();
+}
+
+bool StreamSource::at_end() const { return finished; }
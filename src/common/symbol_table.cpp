@@ -0,0 +1,210 @@
+#include "common/symbol_table.hpp"
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string_view>
+#include <utility>
+
+namespace {
+
+/// How many bytes of names each arena block holds, unless a name is longer.
+constexpr size_t ARENA_BLOCK = 64 * 1024;
+
+/// How many slots each shard starts with. Tables are kept at most half full.
+constexpr size_t INITIAL_SLOTS = 64;
+
+/// Splits a slot into the upper half of its name's hash and its symbol.
+constexpr uint32_t slot_tag(uint64_t slot) { return slot >> 32; }
+constexpr Symbol slot_symbol(uint64_t slot) {
+  return static_cast<Symbol>(slot);
+}
+
+}; // namespace
+
+/* -------------------------------------------------------------------------- */
+/* SHARDS */
+/* -------------------------------------------------------------------------- */
+
+SymbolTable::Slots::Slots(size_t capacity)
+    : mask(capacity - 1),
+      slots(std::make_unique<std::atomic<uint64_t>[]>(capacity)) {
+  assert(std::has_single_bit(capacity));
+}
+
+SymbolTable::Shard::Shard() : count(0), arena_next(nullptr), arena_left(0) {
+  tables.push_back(std::make_unique<Slots>(INITIAL_SLOTS));
+  slots.store(tables.back().get(), std::memory_order_relaxed);
+  for (auto &segment : segments)
+    segment.store(nullptr, std::memory_order_relaxed);
+}
+
+SymbolTable::Shard::~Shard() {
+  for (auto &segment : segments)
+    delete[] segment.load(std::memory_order_relaxed);
+}
+
+std::string_view SymbolTable::store(Shard &shard, std::string_view name) {
+  if (name.size() > shard.arena_left) {
+    const auto size = std::max(name.size(), ARENA_BLOCK);
+    shard.arena.push_back(std::make_unique<char[]>(size));
+    shard.arena_next = shard.arena.back().get();
+    shard.arena_left = size;
+  }
+  char *copy = shard.arena_next;
+  std::memcpy(copy, name.data(), name.size());
+  shard.arena_next += name.size();
+  shard.arena_left -= name.size();
+  return std::string_view(copy, name.size());
+}
+
+std::pair<size_t, size_t> SymbolTable::locate(size_t index) {
+  // Segment `k` holds `FIRST_SEGMENT << k` names, starting at index
+  // `FIRST_SEGMENT * (2^k - 1)`
+  const size_t segment = std::bit_width(index / FIRST_SEGMENT + 1) - 1;
+  return {segment, index - FIRST_SEGMENT * ((size_t(1) << segment) - 1)};
+}
+
+/* -------------------------------------------------------------------------- */
+/* TABLE */
+/* -------------------------------------------------------------------------- */
+
+SymbolTable::SymbolTable() : shards(std::make_unique<Shard[]>(SHARDS)) {}
+
+SymbolTable &SymbolTable::global() {
+  static SymbolTable table;
+  return table;
+}
+
+uint64_t SymbolTable::hash(std::string_view name) {
+  // Mixes the name in eight bytes at a time, then finishes like splitmix64
+  constexpr uint64_t MULTIPLIER = 0xbf58476d1ce4e5b9;
+  uint64_t hash = 0x9e3779b97f4a7c15 ^ name.size();
+  size_t i = 0;
+  for (; i + 8 <= name.size(); i += 8) {
+    uint64_t word;
+    std::memcpy(&word, name.data() + i, 8);
+    hash = (hash ^ word) * MULTIPLIER;
+    hash ^= hash >> 31;
+  }
+  uint64_t tail = 0;
+  std::memcpy(&tail, name.data() + i, name.size() - i);
+  hash = (hash ^ tail) * MULTIPLIER;
+  hash ^= hash >> 27;
+  hash *= 0x94d049bb133111eb;
+  return hash ^ (hash >> 31);
+}
+
+std::optional<Symbol> SymbolTable::probe(const Slots &slots,
+                                         std::string_view name,
+                                         uint64_t hash) const {
+  // Slots are probed from the upper half of the hash, since the lower bits
+  // picked the shard
+  const auto tag = static_cast<uint32_t>(hash >> 32);
+  for (size_t i = tag & slots.mask;; i = (i + 1) & slots.mask) {
+    const auto slot = slots.slots[i].load(std::memory_order_acquire);
+    if (slot == 0)
+      return std::nullopt;
+    if (slot_tag(slot) == tag && this->name(slot_symbol(slot)) == name)
+      return slot_symbol(slot);
+  }
+}
+
+std::optional<Symbol> SymbolTable::find(std::string_view name) const {
+  const auto hash = SymbolTable::hash(name);
+  const auto &shard = shards[hash & (SHARDS - 1)];
+
+  // A writer may have grown the table while it was being probed, in which
+  // case the name may only be in the new one
+  const Slots *slots = shard.slots.load(std::memory_order_acquire);
+  while (true) {
+    if (const auto found = probe(*slots, name, hash))
+      return found;
+    const Slots *latest = shard.slots.load(std::memory_order_acquire);
+    if (latest == slots)
+      return std::nullopt;
+    slots = latest;
+  }
+}
+
+Symbol SymbolTable::intern(std::string_view name) {
+  return intern(name, hash(name));
+}
+
+Symbol SymbolTable::intern(std::string_view name, uint64_t hash) {
+  assert(hash == SymbolTable::hash(name));
+  const auto shard_index = hash & (SHARDS - 1);
+  auto &shard = shards[shard_index];
+
+  // Most names have been seen before, which needs no lock
+  if (const auto found =
+          probe(*shard.slots.load(std::memory_order_acquire), name, hash))
+    return found.value();
+
+  std::lock_guard guard(shard.lock);
+  Slots *slots = shard.slots.load(std::memory_order_relaxed);
+  if (const auto found = probe(*slots, name, hash))
+    return found.value();
+
+  // A symbol packs the index of the name within its shard above the shard
+  // bits, and must still fit in 32 bits once offset past `NO_SYMBOL`
+  const auto index = shard.count;
+  if (index >= (size_t(1) << (32 - SHARD_BITS)) - 1) {
+    std::fprintf(stderr, "fatal: out of symbols interning `%.*s`\n",
+                 static_cast<int>(name.size()), name.data());
+    std::abort();
+  }
+
+  // Readers may still be probing the old table, so it is kept alive, and the
+  // new one is only published once every slot has been copied into it
+  if (2 * (index + 1) > slots->mask + 1) {
+    auto grown = std::make_unique<Slots>(2 * (slots->mask + 1));
+    for (size_t i = 0; i <= slots->mask; ++i) {
+      const auto slot = slots->slots[i].load(std::memory_order_relaxed);
+      if (slot == 0)
+        continue;
+      size_t j = slot_tag(slot) & grown->mask;
+      while (grown->slots[j].load(std::memory_order_relaxed) != 0)
+        j = (j + 1) & grown->mask;
+      grown->slots[j].store(slot, std::memory_order_relaxed);
+    }
+    slots = grown.get();
+    shard.tables.push_back(std::move(grown));
+    shard.slots.store(slots, std::memory_order_release);
+  }
+
+  // The name is stored before its slot is filled, so that a reader that
+  // finds the slot also finds the name
+  const auto [segment, position] = locate(index);
+  assert(segment < SEGMENTS);
+  auto *names = shard.segments[segment].load(std::memory_order_relaxed);
+  if (names == nullptr) {
+    names = new std::string_view[FIRST_SEGMENT << segment];
+    shard.segments[segment].store(names, std::memory_order_release);
+  }
+  names[position] = store(shard, name);
+  ++shard.count;
+
+  const auto symbol =
+      static_cast<Symbol>((size_t(index) << SHARD_BITS | shard_index) + 1);
+  const auto tag = static_cast<uint32_t>(hash >> 32);
+  size_t i = tag & slots->mask;
+  while (slots->slots[i].load(std::memory_order_relaxed) != 0)
+    i = (i + 1) & slots->mask;
+  slots->slots[i].store(uint64_t(tag) << 32 | symbol,
+                        std::memory_order_release);
+  return symbol;
+}
+
+std::string_view SymbolTable::name(Symbol symbol) const {
+  assert(symbol != NO_SYMBOL);
+  const auto id = size_t(symbol) - 1;
+  const auto &shard = shards[id & (SHARDS - 1)];
+  const auto [segment, position] = locate(id >> SHARD_BITS);
+  return shard.segments[segment].load(std::memory_order_acquire)[position];
+}
@@ -0,0 +1,78 @@
+#include "common/thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+ThreadPool::ThreadPool(unsigned threads)
+    : job(nullptr), count(0), next(0), generation(0), active(0),
+      stopping(false) {
+  if (threads == 0)
+    threads = std::max(1u, std::thread::hardware_concurrency());
+
+  // The calling thread is the last member of the pool
+  workers.reserve(threads - 1);
+  for (unsigned i = 1; i < threads; ++i)
+    workers.emplace_back([this] { work(); });
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    const std::lock_guard guard(lock);
+    stopping = true;
+  }
+  wake.notify_all();
+  for (auto &worker : workers)
+    worker.join();
+}
+
+size_t ThreadPool::size() const { return workers.size() + 1; }
+
+void ThreadPool::drain(const std::function<void(size_t)> &job, size_t count) {
+  while (true) {
+    const auto i = next.fetch_add(1, std::memory_order_relaxed);
+    if (i >= count)
+      return;
+    job(i);
+  }
+}
+
+void ThreadPool::work() {
+  size_t seen = 0;
+  while (true) {
+    std::unique_lock guard(lock);
+    wake.wait(guard, [&] { return stopping || generation != seen; });
+    if (stopping)
+      return;
+    seen = generation;
+    const auto *current = job;
+    const auto current_count = count;
+    guard.unlock();
+
+    drain(*current, current_count);
+
+    guard.lock();
+    if (--active == 0)
+      done.notify_one();
+  }
+}
+
+void ThreadPool::run(size_t count, const std::function<void(size_t)> &job) {
+  {
+    const std::lock_guard guard(lock);
+    this->job = &job;
+    this->count = count;
+    next.store(0, std::memory_order_relaxed);
+    active = workers.size();
+    ++generation;
+  }
+  wake.notify_all();
+
+  drain(job, count);
+
+  std::unique_lock guard(lock);
+  done.wait(guard, [&] { return active == 0; });
+  this->job = nullptr;
+}
@@ -1,41 +1,302 @@
 #include "lexer/lexer.hpp"
 #include "common/diagnostic.hpp"
 #include "common/span.hpp"
+#include "common/symbol_table.hpp"
+#include "common/thread_pool.hpp"
+#include "lexer/scan.hpp"
 #include "lexer/token.hpp"
-#include <cctype>
+#include "lexer/token_ring.hpp"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
 #include <optional>
 #include <string_view>
+#include <system_error>
+#include <utility>
+#include <vector>
 
 /* -------------------------------------------------------------------------- */
 /* NON-ASSOCIATED HELPERS */
 /* -------------------------------------------------------------------------- */
 
+/// Every keyword in `KEYWORD_LIST` along with its kind.
+constexpr std::pair<std::string_view, Token::Kind> KEYWORDS[] = {
+#define X(name, repr) {repr, Token::Kind::name},
+    KEYWORD_LIST
+#undef X
+};
+
+/// The number of slots in the keyword table, at least twice the number of
+/// keywords so that a perfect hash is quick to find.
+constexpr size_t KEYWORD_SLOTS = std::bit_ceil(std::size(KEYWORDS) * 2);
+
+constexpr size_t MAX_KEYWORD_LENGTH =
+    std::ranges::max(KEYWORDS, {}, [](const auto &kw) {
+      return kw.first.size();
+    }).first.size();
+
+/// Hashes a non-empty identifier by its length and its first and last bytes
+/// into a slot of the keyword table, with multiplicative hashing by `seed`.
+constexpr size_t keyword_hash(const std::string_view &sv, uint32_t seed) {
+  const uint32_t key = static_cast<uint32_t>(sv.size() & 0xff) << 16 |
+                       static_cast<uint32_t>(sv.front() & 0xff) << 8 |
+                       static_cast<uint32_t>(sv.back() & 0xff);
+  return (key * seed) >> (32 - std::countr_zero(KEYWORD_SLOTS));
+}
+
+/// Finds the first seed under which every keyword hashes to its own slot.
+constexpr uint32_t find_keyword_seed() {
+  for (uint32_t seed = 1; seed < 1'000'000; seed += 2) {
+    bool taken[KEYWORD_SLOTS] = {};
+    bool perfect = true;
+    for (const auto &[repr, kind] : KEYWORDS) {
+      const auto slot = keyword_hash(repr, seed);
+      perfect &= !taken[slot];
+      taken[slot] = true;
+    }
+    if (perfect)
+      return seed;
+  }
+  return 0;
+}
+
+constexpr uint32_t KEYWORD_SEED = find_keyword_seed();
+static_assert(KEYWORD_SEED != 0,
+              "No perfect hash for KEYWORD_LIST, KEYWORD_SLOTS must grow");
+
+/// Maps every slot to one more than the index of the keyword that hashes to
+/// it, or to `0` if no keyword does.
+constexpr auto KEYWORD_TABLE = [] {
+  static_assert(std::size(KEYWORDS) < 0xff);
+  std::array<uint8_t, KEYWORD_SLOTS> table{};
+  for (size_t i = 0; i < std::size(KEYWORDS); ++i)
+    table[keyword_hash(KEYWORDS[i].first, KEYWORD_SEED)] =
+        static_cast<uint8_t>(i + 1);
+  return table;
+}();
+
+/// Returns the kind of keyword `sv` is, or `Identifier`. Costs one probe of
+/// the keyword table and at most one comparison.
 Token::Kind keyword_or_identifier(const std::string_view &sv) {
-  using enum Token::Kind;
+  if (sv.size() > MAX_KEYWORD_LENGTH)
+    return Token::Kind::Identifier;
 
-  if (sv == "if")
-    return If;
-  if (sv == "else")
-    return Else;
-  if (sv == "function")
-    return Function;
-  if (sv == "for")
-    return For;
-  if (sv == "break")
-    return Break;
-  if (sv == "continue")
-    return Continue;
+  const auto entry = KEYWORD_TABLE[keyword_hash(sv, KEYWORD_SEED)];
+  if (entry != 0 && KEYWORDS[entry - 1].first == sv)
+    return KEYWORDS[entry - 1].second;
 
   // default to identifier
-  return Identifier;
+  return Token::Kind::Identifier;
 }
 
-bool is_ident_start(const char &ch) { return std::isalpha(ch) || ch == '_'; }
-bool is_ident_cont(const char &ch) { return std::isalnum(ch) || ch == '_'; }
-bool is_number_start(const char &ch) { return std::isdigit(ch); }
-bool is_number_cont(const char &ch) { return std::isdigit(ch) || ch == '.'; }
-bool is_whitespace(const char &ch) {
-  return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\v' || ch == '\b';
+/// What `Lexer::lex_once()` does with the first character of a token.
+enum class Lead : uint8_t {
+  Invalid,
+  /// A `'\0'`, which is either the end of the source or an invalid character.
+  Sentinel,
+  Identifier,
+  Number,
+  /// A token that is only ever this one character.
+  Single,
+  /// An operator that may continue past this character.
+  Operator,
+  /// The opening quote of a string literal.
+  String,
+  /// The start of a line comment.
+  Comment,
+};
+
+struct LeadEntry {
+  Lead lead;
+  /// The token this character is on its own, for `Single` and `Operator`.
+  Token::Kind kind;
+};
+
+/// Every token of `TOKEN_LIST` along with its representation.
+constexpr std::pair<std::string_view, Token::Kind> TOKENS[] = {
+#define X(name, repr) {repr, Token::Kind::name},
+    TOKEN_LIST
+#undef X
+};
+
+/// Whether `repr` is spelled with punctuation only, which is true of every
+/// operator and delimiter and of none of the keywords and meta tokens.
+constexpr bool is_punctuation(const std::string_view &repr) {
+  return std::ranges::all_of(repr, [](char ch) {
+    return ch > ' ' && ch < 0x7f && !scan::is_ident_cont(ch);
+  });
+}
+
+/// The lead of every byte value, derived from the character classes and the
+/// representations in `TOKEN_LIST`, so that `lex_once()` makes a single
+/// indexed jump on the first character of each token.
+constexpr std::array<LeadEntry, 256> LEADS = [] {
+  std::array<LeadEntry, 256> table{};
+  table.fill({Lead::Invalid, Token::Kind::Eof});
+  for (unsigned c = 0; c < 256; ++c) {
+    if (scan::is_ident_start(static_cast<char>(c)))
+      table[c].lead = Lead::Identifier;
+    if (scan::is_number_start(static_cast<char>(c)))
+      table[c].lead = Lead::Number;
+  }
+  for (const auto &[repr, kind] : TOKENS) {
+    if (repr.size() == 1 && is_punctuation(repr))
+      table[static_cast<unsigned char>(repr[0])] = {Lead::Single, kind};
+  }
+  for (const auto &[repr, kind] : TOKENS) {
+    if (repr.size() > 1 && is_punctuation(repr))
+      table[static_cast<unsigned char>(repr[0])].lead = Lead::Operator;
+  }
+  table['\n'] = {Lead::Single, Token::Kind::Newline};
+  table['"'].lead = Lead::String;
+  table['#'].lead = Lead::Comment;
+  table['\0'].lead = Lead::Sentinel;
+  return table;
+}();
+
+static_assert(LEADS['('].lead == Lead::Single);
+static_assert(LEADS['+'].lead == Lead::Operator);
+static_assert(LEADS['+'].kind == Token::Kind::Plus);
+
+/// Whether `repr` is spelled by an operator in `TOKEN_LIST`.
+constexpr bool is_operator(const std::string_view &repr) {
+  return is_punctuation(repr) &&
+         std::ranges::find(TOKENS, repr, [](const auto &token) {
+           return token.first;
+         }) != std::end(TOKENS);
+}
+
+/// How many bytes past the end of an operator lexing it may look at. Reading
+/// stops at the first byte that can't continue the bytes so far into an
+/// operator, and then backs up to the longest operator among them.
+constexpr size_t OPERATOR_LOOKAHEAD = [] {
+  size_t lookahead = 0;
+  for (const auto &[repr, kind] : TOKENS) {
+    if (!is_punctuation(repr))
+      continue;
+    size_t accepted = 0;
+    for (size_t i = 1; i <= repr.size(); ++i) {
+      if (is_operator(repr.substr(0, i)))
+        accepted = i;
+      lookahead = std::max(lookahead, i + 1 - accepted);
+    }
+  }
+  return lookahead;
+}();
+
+static_assert(OPERATOR_LOOKAHEAD <= MAX_LOOKAHEAD,
+              "Lexing an operator looks further ahead than MAX_LOOKAHEAD");
+static_assert(std::ranges::all_of(TOKENS,
+                                  [](const auto &token) {
+                                    const auto &repr = token.first;
+                                    return !is_punctuation(repr) ||
+                                           is_operator(repr.substr(0, 1));
+                                  }),
+              "The first byte of every operator must be an operator itself");
+
+/// The bytes that appear in operators, each of which gets a column in the
+/// operator DFA, and the number of states of the DFA, which is one per
+/// distinct prefix of an operator plus the start state.
+constexpr auto OPERATOR_SHAPE = [] {
+  std::array<bool, 256> used{};
+  std::vector<std::string_view> prefixes;
+  for (const auto &[repr, kind] : TOKENS) {
+    if (!is_punctuation(repr))
+      continue;
+    for (size_t i = 0; i < repr.size(); ++i) {
+      used[static_cast<unsigned char>(repr[i])] = true;
+      if (std::ranges::find(prefixes, repr.substr(0, i + 1)) == prefixes.end())
+        prefixes.push_back(repr.substr(0, i + 1));
+    }
+  }
+  return std::pair(static_cast<size_t>(std::ranges::count(used, true)) + 1,
+                   prefixes.size() + 1);
+}();
+
+/// A trie of every operator in `TOKEN_LIST`, as a DFA that takes one step per
+/// byte. Bytes are first mapped to a column, with column `0` for bytes that
+/// are in no operator, and state `0` is both the start state and the state
+/// that every byte which can't continue an operator leads to.
+struct OperatorDfa {
+  static constexpr size_t COLUMNS = OPERATOR_SHAPE.first;
+  static constexpr size_t STATES = OPERATOR_SHAPE.second;
+  static_assert(STATES <= 0xff);
+
+  std::array<uint8_t, 256> column{};
+  std::array<std::array<uint8_t, COLUMNS>, STATES> next{};
+  std::array<bool, STATES> accepts{};
+  std::array<Token::Kind, STATES> kinds{};
+};
+
+constexpr OperatorDfa OPERATOR_DFA = [] {
+  OperatorDfa dfa;
+  uint8_t columns = 1;
+  uint8_t states = 1;
+  for (const auto &[repr, kind] : TOKENS) {
+    if (!is_punctuation(repr))
+      continue;
+    uint8_t state = 0;
+    for (const char ch : repr) {
+      auto &column = dfa.column[static_cast<unsigned char>(ch)];
+      if (column == 0)
+        column = columns++;
+      if (dfa.next[state][column] == 0)
+        dfa.next[state][column] = states++;
+      state = dfa.next[state][column];
+    }
+    dfa.accepts[state] = true;
+    dfa.kinds[state] = kind;
+  }
+  return dfa;
+}();
+
+/// Returns the byte that the escape `\<ch>` in a string literal stands for, or
+/// `std::nullopt` if it isn't a valid escape.
+constexpr std::optional<char> escape_value(char ch) {
+  switch (ch) {
+  case 'n':
+    return '\n';
+  case 't':
+    return '\t';
+  case 'r':
+    return '\r';
+  case '0':
+    return '\0';
+  case '\\':
+  case '"':
+  case '\'':
+    return ch;
+  default:
+    return std::nullopt;
+  }
+}
+
+/// Returns the value of the decimal literal `lexeme`, correctly rounded, or
+/// `std::nullopt` if it is too large for a `double`.
+std::optional<double> decimal_value(std::string_view lexeme) {
+  double value = 0;
+  const auto [end, ec] =
+      std::from_chars(lexeme.data(), lexeme.data() + lexeme.size(), value);
+  if (end != lexeme.data() + lexeme.size())
+    return std::nullopt;
+
+  // A value that rounds to zero is reported as out of range too, but only a
+  // literal with a nonzero integer part can be too large
+  if (ec == std::errc::result_out_of_range) {
+    const auto integer = lexeme.substr(0, lexeme.find('.'));
+    if (integer.find_first_not_of('0') == std::string_view::npos)
+      return 0.0;
+  }
+  if (ec != std::errc())
+    return std::nullopt;
+  return value;
 }
 
 /* -------------------------------------------------------------------------- */
@@ -46,23 +307,57 @@ Lexer::Lexer(const Source &source, TokenCollect &tokens,
              DiagCollect &diagnostics)
     : source(source), diagnostics(diagnostics), tokens(tokens), cursor(0) {}
 
-bool Lexer::is_at_end(unsigned k) const { return cursor + k >= source.size; }
+bool Lexer::is_at_end() const { return cursor >= source.size; }
 void Lexer::skip_whitespace() {
-  while (is_whitespace(current()))
-    eat();
+  cursor += scan::span_whitespace(source.content.data() + cursor);
 }
 
-char Lexer::current() const { return peek(0); }
-char Lexer::peek(unsigned k) const {
-  if (is_at_end(k))
-    return '\0';
-  return source.content.at(cursor + k);
+void Lexer::skip_line_comment() {
+  const auto start = cursor;
+  const char *data = source.content.data();
+  const void *newline = std::memchr(data + cursor, '\n', source.size - cursor);
+  cursor = newline == nullptr ? source.size
+                              : static_cast<const char *>(newline) - data;
+  tokens.push_trivia(Span(source, start, cursor - start));
 }
 
+void Lexer::skip_block_comment() {
+  const auto start = cursor;
+  const char *data = source.content.data();
+  size_t depth = 1;
+  eat(2);
+  while (depth > 0) {
+    cursor += scan::span_comment(data + cursor);
+    const auto ch = current();
+    if (ch == '*' && peek() == '/') {
+      --depth;
+      eat(2);
+    } else if (ch == '/' && peek() == '*') {
+      ++depth;
+      eat(2);
+    } else if (ch != '\0' || !is_at_end()) {
+      eat();
+    } else {
+      // The comment runs to the end of the source
+      const Span span(source, start, cursor - start);
+      diagnostics.push(
+          Diagnostic(Diagnostic::Issue::UnterminatedComment, span));
+      break;
+    }
+  }
+  tokens.push_trivia(Span(source, start, cursor - start));
+}
+
+// The cursor never passes the first sentinel byte, and no token looks further
+// than `MAX_LOOKAHEAD` past its end, so reads stay within `SOURCE_PADDING`
+static_assert(MAX_LOOKAHEAD < SOURCE_PADDING);
+
+char Lexer::current() const { return peek(0); }
+char Lexer::peek(unsigned k) const { return source.content.data()[cursor + k]; }
+
 void Lexer::eat(unsigned k) {
-  if (is_at_end(k))
-    cursor = source.size;
   cursor += k;
+  assert(cursor <= source.size && "Lexer ate the sentinel");
 }
 
 /* -------------------------------------------------------------------------- */
@@ -72,194 +367,169 @@ void Lexer::eat(unsigned k) {
 Token Lexer::lex_identifier() {
   const auto start = cursor;
 
-  // Keep consuming while the NEXT character is a valid ident
-  while (is_ident_cont(peek())) {
-    eat();
-  }
+  // Consume every character after this one that is a valid ident, so that the
+  // cursor ends on the last one
+  cursor += scan::span_identifier(source.content.data() + start + 1);
 
   // Now the next character is invalid, push a token and the next cycle will
   // handle the invalid
   const Span span(source, start, cursor - start + 1);
-  const auto sv = span.lexeme();
+  const auto sv = source.content.substr(start, span.length);
   const auto kind = keyword_or_identifier(sv);
-  return Token(kind, span);
+  if (kind != Token::Kind::Identifier)
+    return Token(kind, span);
+  return Token(kind, span, SymbolTable::global().intern(sv));
 }
 
 Token Lexer::lex_number() {
   const auto start = cursor;
-  auto kind = Token::Kind::Integer;
-
-  while (is_number_cont(peek())) {
-    if (peek() == '.') {
-      if (kind == Token::Kind::Integer && is_number_start(peek(2))) {
-        // This implies the dot is part of this token and the thing after the
-        // dot is also a valid number
-        kind = Token::Kind::Decimal;
-      } else {
-        // This implies the dot is not part of this token, so break here
-        break;
-      }
+  const char *data = source.content.data();
+  cursor += scan::span_digits(data + start + 1);
+
+  if (peek() == '.' && scan::is_number_start(peek(2))) {
+    const auto integer_digits = cursor - start + 1;
+    eat(2);
+    cursor += scan::span_digits(data + cursor + 1);
+    const Span span(source, start, cursor - start + 1);
+
+    // Only a literal with as many integer digits as the largest double can be
+    // too large, so the rest are never converted here
+    if (integer_digits >= std::numeric_limits<double>::max_exponent10 + 1 &&
+        !decimal_value(source.content.substr(start, span.length))) {
+      diagnostics.push(Diagnostic(Diagnostic::Issue::LiteralOverflow, span,
+                                  Diagnostic::Arg(span),
+                                  Diagnostic::Arg("decimal")));
     }
-    eat();
+    return Token(Token::Kind::Decimal, span);
   }
 
-  // Now the next character is invalid, push a token and the next cycle will
-  // handle the invalid
+  // The value is accumulated here, while the digits are still in cache, and
+  // carried by the token itself. It stops as soon as it is too large, however
+  // many digits are left
   const Span span(source, start, cursor - start + 1);
-  return Token(kind, span);
+  constexpr auto MAX = static_cast<uint64_t>(INT32_MAX);
+  uint64_t value = 0;
+  for (size_t i = start; i <= cursor && value <= MAX; ++i)
+    value = value * 10 + static_cast<uint64_t>(data[i] - '0');
+  if (value > MAX) {
+    diagnostics.push(Diagnostic(Diagnostic::Issue::LiteralOverflow, span,
+                                Diagnostic::Arg(span),
+                                Diagnostic::Arg("32-bit integer")));
+    value = MAX;
+  }
+  return Token(Token::Kind::Integer, span, static_cast<Symbol>(value));
 }
 
-// std::expected<Token, Diagnostic> Lexer::lex_string();
-std::optional<Token> Lexer::lex_once() {
-  using enum Token::Kind;
-
-  // Skip so the current thing is meaningful character
-  skip_whitespace();
+Token Lexer::lex_operator() {
   const auto start = cursor;
-  const auto ch = peek(0);
+  const char *data = source.content.data() + start;
 
-  // Early return on the EOF case
-  if (is_at_end())
-    return Token(Eof, Span(source, cursor, 1));
-  if (is_ident_start(ch))
-    return lex_identifier();
-  if (is_number_start(ch))
-    return lex_number();
+  // Walk the operator trie for as long as the bytes spell a prefix of some
+  // operator, remembering the longest one that was a whole operator. The first
+  // byte always is one, having been given the `Operator` lead.
+  uint8_t state = 0;
+  size_t length = 0;
+  auto kind = Token::Kind::Eof;
+  for (size_t i = 0;; ++i) {
+    const auto column = OPERATOR_DFA.column[static_cast<uint8_t>(data[i])];
+    state = OPERATOR_DFA.next[state][column];
+    if (state == 0)
+      break;
+    if (OPERATOR_DFA.accepts[state]) {
+      kind = OPERATOR_DFA.kinds[state];
+      length = i + 1;
+    }
+  }
 
-  const auto peek1 = peek(1);
-  const auto peek2 = peek(2);
+  cursor += length - 1;
+  return Token(kind, Span(source, start, length));
+}
 
-  switch (ch) {
+std::optional<Token> Lexer::lex_string() {
+  const auto start = cursor;
+  const char *data = source.content.data();
+  bool valid = true;
 
-  case '\n':
-    return Token(Newline, Span(source, cursor, 1));
-  case '(':
-    return Token(LParen, Span(source, cursor, 1));
-  case ')':
-    return Token(RParen, Span(source, cursor, 1));
-  case '[':
-    return Token(LBrac, Span(source, cursor, 1));
-  case ']':
-    return Token(RBrac, Span(source, cursor, 1));
-  case '{':
-    return Token(LCurl, Span(source, cursor, 1));
-  case '}':
-    return Token(RCurl, Span(source, cursor, 1));
-  case '.':
-    return Token(Dot, Span(source, cursor, 1));
-  case ',':
-    return Token(Comma, Span(source, cursor, 1));
-  case ':':
-    return Token(Colon, Span(source, cursor, 1));
-  case ';':
-    return Token(Semicolon, Span(source, cursor, 1));
-  case '?':
-    return Token(Question, Span(source, cursor, 1));
-  case '%':
-    return Token(Percent, Span(source, cursor, 1));
-
-  case '+': {
-    if (peek1 == '+') {
-      eat();
-      return Token(PlusPlus, Span(source, start, 2));
-    }
-    if (peek1 == '=') {
-      eat();
-      return Token(PlusEqual, Span(source, start, 2));
-    }
-    return Token(Plus, Span(source, start, 1));
-  }
-  case '-': {
-    if (peek1 == '-') {
-      eat();
-      return Token(MinusMinus, Span(source, start, 2));
-    }
-    if (peek1 == '=') {
-      eat();
-      return Token(MinusEqual, Span(source, start, 2));
-    }
-    return Token(Minus, Span(source, start, 1));
-  }
-  case '*': {
-    if (peek1 == '*' && peek2 == '=') {
-      eat(2);
-      return Token(StarStarEqual, Span(source, start, 3));
-    }
-    if (peek1 == '*') {
-      eat();
-      return Token(StarStar, Span(source, start, 2));
-    }
-    if (peek1 == '=') {
-      eat();
-      return Token(StarEqual, Span(source, start, 2));
-    }
-    return Token(Star, Span(source, start, 1));
-  }
-  case '/': {
-    if (peek1 == '/' && peek2 == '=') {
-      eat(2);
-      return Token(SlashSlashEqual, Span(source, start, 3));
-    }
-    if (peek1 == '/') {
-      eat();
-      return Token(SlashSlash, Span(source, start, 2));
-    }
-    if (peek1 == '=') {
-      eat();
-      return Token(SlashEqual, Span(source, start, 2));
-    }
-    return Token(Slash, Span(source, start, 1));
-  }
+  // Jump from one quote, backslash, newline or sentinel to the next, until
+  // the closing quote
+  while (true) {
+    cursor += 1 + scan::span_string(data + cursor + 1);
+    const auto ch = current();
+    if (ch == '"')
+      break;
 
-  case '<': {
-    if (peek1 == '=') {
-      eat();
-      return Token(LessEqual, Span(source, start, 2));
-    }
-    return Token(Less, Span(source, start, 1));
-  }
-  case '>': {
-    if (peek1 == '=') {
-      eat();
-      return Token(MoreEqual, Span(source, start, 2));
-    }
-    return Token(More, Span(source, start, 1));
-  }
-  case '!': {
-    if (peek1 == '=') {
-      eat();
-      return Token(BangEqual, Span(source, start, 2));
-    }
-    return Token(Bang, Span(source, start, 1));
-  }
-  case '=': {
-    if (peek1 == '=') {
-      eat();
-      return Token(EqualEqual, Span(source, start, 2));
+    // An escape is validated and skipped, unless what it escapes ends the line
+    if (ch == '\\') {
+      const auto escaped = peek();
+      valid = valid && escape_value(escaped).has_value();
+      if (escaped != '\n' && (escaped != '\0' || cursor + 1 < source.size))
+        eat();
+      continue;
     }
-    return Token(Equal, Span(source, start, 1));
+
+    // A `'\0'` before the end is just a byte of the literal
+    if (ch == '\0' && !is_at_end())
+      continue;
+
+    // A newline or the end of the source, leaving the cursor on the last byte
+    // of the literal
+    const Span span(source, start, cursor - start);
+    diagnostics.push(Diagnostic(Diagnostic::Issue::UnterminatedString, span));
+    cursor -= 1;
+    return std::nullopt;
   }
 
-  case '&': {
-    if (peek1 == '&') {
-      eat();
-      return Token(AndAnd, Span(source, start, 2));
-    }
-    return Token(And, Span(source, start, 1));
+  const Span span(source, start, cursor - start + 1);
+  if (!valid) {
+    diagnostics.push(Diagnostic(Diagnostic::Issue::InvalidString, span));
+    return std::nullopt;
   }
-  case '|': {
-    if (peek1 == '|') {
-      eat();
-      return Token(BarBar, Span(source, start, 2));
-    }
-    return Token(Bar, Span(source, start, 1));
+  return Token(Token::Kind::String, span);
+}
+
+std::optional<Token> Lexer::lex_once() {
+  using enum Token::Kind;
+
+  // Skip so the current thing is meaningful character, comments included
+  skip_whitespace();
+  auto ch = peek(0);
+  auto lead = LEADS[static_cast<unsigned char>(ch)];
+  while (lead.lead == Lead::Comment || (ch == '/' && peek() == '*')) {
+    if (lead.lead == Lead::Comment)
+      skip_line_comment();
+    else
+      skip_block_comment();
+    skip_whitespace();
+    ch = peek(0);
+    lead = LEADS[static_cast<unsigned char>(ch)];
   }
+  const auto start = cursor;
+
+  // EOF is only checked for when the sentinel is seen
+  switch (lead.lead) {
+  case Lead::Sentinel:
+    if (is_at_end())
+      return Token(Eof, Span(source, cursor, 1));
+    break;
+  case Lead::Identifier:
+    return lex_identifier();
+  case Lead::Number:
+    return lex_number();
+  case Lead::Single:
+    return Token(lead.kind, Span(source, start, 1));
+  case Lead::Operator:
+    return lex_operator();
+  case Lead::String:
+    return lex_string();
+  case Lead::Comment:
+  case Lead::Invalid:
+    break;
   }
 
   // If nothing else matches it's an illegal character
-  const auto diag = Diagnostic(Diagnostic::Issue::InvalidCharacter,
-                               Span(source, start, cursor - start + 1),
-                               "This character is not allowed.");
+  const Span span(source, start, cursor - start + 1);
+  const auto diag = Diagnostic(Diagnostic::Issue::InvalidCharacter, span,
+                               Diagnostic::Arg(span));
   diagnostics.push(diag);
   return std::nullopt;
 }
@@ -268,21 +538,212 @@ std::optional<Token> Lexer::lex_once() {
 /* MAIN LOOP */
 /* -------------------------------------------------------------------------- */
 
-void Lexer::lex() {
-  while (true) {
+bool Lexer::lex_until(size_t end) {
+  while (cursor < end) {
     const auto maybe_token = lex_once();
 
     // Check if the token is valid
     if (maybe_token.has_value()) {
       const auto token = maybe_token.value();
-      tokens.push(token);
 
-      // Break out of this loop if the last token is found
+      // Stop once the last token is found, the caller pushes it
       if (token.kind == Token::Kind::Eof) {
-        break;
+        return false;
       }
+      tokens.push(token);
+    } else if (diagnostics.limit_reached()) {
+      // Bail out as soon as an error reaches the limit
+      return true;
     }
     // Skip to next char
     eat();
   }
-}
\ No newline at end of file
+  return false;
+}
+
+bool Lexer::lex_start() {
+  // Invalid bytes are still lexed, so report the encoding up front
+  if (source.invalid_utf8.has_value()) {
+    const auto diag = Diagnostic(Diagnostic::Issue::InvalidEncoding,
+                                 Span(source, source.invalid_utf8.value(), 1));
+    diagnostics.push(diag);
+  }
+  cursor = 0;
+  return !diagnostics.limit_reached();
+}
+
+void Lexer::lex() {
+  if (lex_start())
+    lex_until(source.size);
+
+  // Close off whatever was lexed, whether or not it bailed out early
+  tokens.push(Token(Token::Kind::Eof, Span(source, source.size, 1)));
+}
+
+void Lexer::lex(TokenRing &ring) {
+  if (lex_start()) {
+    while (cursor < source.size) {
+      const bool bail =
+          lex_until(std::min(cursor + TOKEN_BATCH_BYTES, source.size));
+      if (bail)
+        break;
+      ring.publish(tokens);
+    }
+  }
+
+  // The batch holding the `Eof` token ends the stream
+  tokens.push(Token(Token::Kind::Eof, Span(source, source.size, 1)));
+  ring.publish(tokens);
+}
+
+size_t Lexer::relex(const SourceEdit &edit) {
+  const size_t count = tokens.size();
+  const size_t edit_end = edit.offset + edit.inserted.size();
+  const auto shift = static_cast<std::ptrdiff_t>(edit.inserted.size()) -
+                     static_cast<std::ptrdiff_t>(edit.removed);
+  assert(edit_end <= source.size);
+
+  // The first token that could change is the first whose lookahead reaches
+  // the edit. Lexing restarts where the token before it ended, which is where
+  // the lexer stood between the two.
+  const auto end_of = [&](size_t i) {
+    return static_cast<size_t>(tokens.offset(i)) + tokens.length(i);
+  };
+  size_t first = 0;
+  for (size_t step = std::bit_floor(count); step > 0; step /= 2)
+    if (first + step <= count &&
+        end_of(first + step - 1) + MAX_LOOKAHEAD <= edit.offset)
+      first += step;
+
+  // The lexer keeps no state between tokens, so once a token past the edit
+  // starts where an old one did, every token from there on is the same
+  TokenCollect relexed(source, tokens.keeps_trivia());
+  Lexer lexer(source, relexed, diagnostics);
+  lexer.cursor = first == 0 ? 0 : end_of(first - 1);
+  size_t last = first;
+  while (true) {
+    const auto maybe_token = lexer.lex_once();
+    if (maybe_token.has_value()) {
+      const auto token = maybe_token.value();
+      const size_t start = token.span.offset - source.base;
+      if (start >= edit_end) {
+        const auto old_start =
+            static_cast<size_t>(static_cast<std::ptrdiff_t>(start) - shift);
+        while (last < count && tokens.offset(last) < old_start)
+          ++last;
+        if (last < count && tokens.offset(last) == old_start)
+          break;
+      }
+
+      relexed.push(token);
+      if (token.kind == Token::Kind::Eof) {
+        last = count;
+        break;
+      }
+    }
+    lexer.eat();
+  }
+
+  tokens.splice(first, last, relexed, shift);
+  return relexed.size();
+}
+
+void Lexer::lex(ThreadPool &pool, size_t chunk_size) {
+  if (source.size <= chunk_size || pool.size() == 1) {
+    lex();
+    return;
+  }
+
+  // Split after the first newline at or past every `chunk_size` bytes, so
+  // that chunks almost always begin at the start of a token
+  const char *data = source.content.data();
+  std::vector<size_t> bounds = {0};
+  while (bounds.back() < source.size) {
+    const auto from = bounds.back() + chunk_size;
+    const void *newline =
+        from < source.size
+            ? std::memchr(data + from, '\n', source.size - from)
+            : nullptr;
+    bounds.push_back(newline == nullptr
+                         ? source.size
+                         : static_cast<const char *>(newline) - data + 1);
+  }
+
+  // Lex every chunk speculatively, as if it began at the start of a token,
+  // into its own collections
+  struct Chunk {
+    TokenCollect tokens;
+    DiagCollect diagnostics;
+
+    /// Where the cursor stopped, past the chunk if its last token crosses it.
+    size_t exit = 0;
+
+    Chunk(const Source &source, bool keep_trivia)
+        : tokens(source, keep_trivia) {}
+  };
+  const size_t count = bounds.size() - 1;
+  std::vector<std::unique_ptr<Chunk>> chunks(count);
+  pool.run(count, [&](size_t i) {
+    chunks[i] = std::make_unique<Chunk>(source, tokens.keeps_trivia());
+    Lexer lexer(source, chunks[i]->tokens, chunks[i]->diagnostics);
+    lexer.cursor = bounds[i];
+    lexer.lex_until(bounds[i + 1]);
+    chunks[i]->exit = lexer.cursor;
+  });
+
+  // Stitch the chunks together in order. A chunk is only kept if the previous
+  // one stopped exactly where it began, otherwise it began inside a token and
+  // is lexed again from where that token ended. It is also lexed again when it
+  // would reach the error limit, so that this bails out exactly where `lex()`
+  // does
+  if (lex_start()) {
+    for (size_t i = 0; i < count; ++i) {
+      const auto &chunk = *chunks[i];
+      if (cursor != bounds[i] ||
+          diagnostics.limit_reached(chunk.diagnostics.error_count())) {
+        if (lex_until(bounds[i + 1]))
+          break;
+        continue;
+      }
+      tokens.append(chunk.tokens);
+      for (const auto &diag : chunk.diagnostics)
+        diagnostics.push(diag);
+      cursor = chunk.exit;
+    }
+  }
+  tokens.push(Token(Token::Kind::Eof, Span(source, source.size, 1)));
+}
+
+/* -------------------------------------------------------------------------- */
+/* LITERAL DECODING */
+/* -------------------------------------------------------------------------- */
+
+std::string_view decode_string(const Source &source, const Token &token,
+                               std::string &buffer) {
+  assert(token.kind == Token::Kind::String);
+  const auto lexeme = token.span.lexeme(source);
+  const auto body = lexeme.substr(1, lexeme.size() - 2);
+
+  // Most literals have no escapes, so their value is their body
+  auto escape = body.find('\\');
+  if (escape == std::string_view::npos)
+    return body;
+
+  buffer.clear();
+  buffer.reserve(body.size());
+  size_t from = 0;
+  while (escape != std::string_view::npos) {
+    buffer.append(body.substr(from, escape - from));
+    buffer.push_back(escape_value(body[escape + 1]).value());
+    from = escape + 2;
+    escape = body.find('\\', from);
+  }
+  buffer.append(body.substr(from));
+  return buffer;
+}
+
+std::optional<double> decode_decimal(const Source &source,
+                                     const Token &token) {
+  assert(token.kind == Token::Kind::Decimal);
+  return decimal_value(token.span.lexeme(source));
+}
@@ -0,0 +1,214 @@
+#include "lexer/scan.hpp"
+#include "common/simd.hpp"
+#include "common/span.hpp"
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ALTA_SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+namespace scan {
+
+static_assert(SOURCE_PADDING >= 32, "The AVX2 scanners read 32 bytes at once");
+
+namespace {
+
+/* -------------------------------------------------------------------------- */
+/* SCALAR IMPLEMENTATIONS */
+/* -------------------------------------------------------------------------- */
+
+template <bool (*accept)(char)> size_t span_scalar(const char *data) {
+  size_t i = 0;
+  while (accept(data[i]))
+    ++i;
+  return i;
+}
+
+/* -------------------------------------------------------------------------- */
+/* X86 IMPLEMENTATIONS */
+/* -------------------------------------------------------------------------- */
+
+#ifdef ALTA_SIMD_X86
+
+// Each classifier sets every byte of its result that belongs to the class to
+// `0xff`. Unsigned ranges are tested with a signed compare after shifting the
+// range to start at -128, since SSE2 and AVX2 only compare signed bytes.
+
+#define ALTA_SSE2 __attribute__((target("sse2"), always_inline)) inline
+#define ALTA_AVX2 __attribute__((target("avx2"), always_inline)) inline
+
+ALTA_SSE2 __m128i in_range_sse2(__m128i bytes, char low, char count) {
+  const __m128i shifted =
+      _mm_add_epi8(bytes, _mm_set1_epi8(static_cast<char>(0x80 - low)));
+  return _mm_cmplt_epi8(shifted,
+                        _mm_set1_epi8(static_cast<char>(0x80 + count)));
+}
+
+ALTA_SSE2 __m128i whitespace_sse2(__m128i bytes) {
+  __m128i match = _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' '));
+  for (const char ch : {'\t', '\r', '\v', '\b'})
+    match = _mm_or_si128(match, _mm_cmpeq_epi8(bytes, _mm_set1_epi8(ch)));
+  return match;
+}
+
+ALTA_SSE2 __m128i digits_sse2(__m128i bytes) {
+  return in_range_sse2(bytes, '0', 10);
+}
+
+ALTA_SSE2 __m128i identifier_sse2(__m128i bytes) {
+  // Setting bit 5 folds upper case letters onto lower case ones
+  const __m128i letter =
+      in_range_sse2(_mm_or_si128(bytes, _mm_set1_epi8(0x20)), 'a', 26);
+  const __m128i underscore = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('_'));
+  const __m128i non_ascii = _mm_cmplt_epi8(bytes, _mm_setzero_si128());
+  return _mm_or_si128(_mm_or_si128(letter, underscore),
+                      _mm_or_si128(non_ascii, digits_sse2(bytes)));
+}
+
+ALTA_SSE2 __m128i string_sse2(__m128i bytes) {
+  __m128i stop = _mm_cmpeq_epi8(bytes, _mm_setzero_si128());
+  for (const char ch : {'"', '\\', '\n'})
+    stop = _mm_or_si128(stop, _mm_cmpeq_epi8(bytes, _mm_set1_epi8(ch)));
+  return _mm_xor_si128(stop, _mm_set1_epi8(-1));
+}
+
+ALTA_SSE2 __m128i comment_sse2(__m128i bytes) {
+  __m128i stop = _mm_cmpeq_epi8(bytes, _mm_setzero_si128());
+  for (const char ch : {'*', '/'})
+    stop = _mm_or_si128(stop, _mm_cmpeq_epi8(bytes, _mm_set1_epi8(ch)));
+  return _mm_xor_si128(stop, _mm_set1_epi8(-1));
+}
+
+ALTA_AVX2 __m256i in_range_avx2(__m256i bytes, char low, char count) {
+  const __m256i shifted =
+      _mm256_add_epi8(bytes, _mm256_set1_epi8(static_cast<char>(0x80 - low)));
+  return _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(0x80 + count)),
+                           shifted);
+}
+
+ALTA_AVX2 __m256i whitespace_avx2(__m256i bytes) {
+  __m256i match = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(' '));
+  for (const char ch : {'\t', '\r', '\v', '\b'})
+    match =
+        _mm256_or_si256(match, _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(ch)));
+  return match;
+}
+
+ALTA_AVX2 __m256i digits_avx2(__m256i bytes) {
+  return in_range_avx2(bytes, '0', 10);
+}
+
+ALTA_AVX2 __m256i identifier_avx2(__m256i bytes) {
+  // Setting bit 5 folds upper case letters onto lower case ones
+  const __m256i letter =
+      in_range_avx2(_mm256_or_si256(bytes, _mm256_set1_epi8(0x20)), 'a', 26);
+  const __m256i underscore = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('_'));
+  const __m256i non_ascii = _mm256_cmpgt_epi8(_mm256_setzero_si256(), bytes);
+  return _mm256_or_si256(_mm256_or_si256(letter, underscore),
+                         _mm256_or_si256(non_ascii, digits_avx2(bytes)));
+}
+
+ALTA_AVX2 __m256i string_avx2(__m256i bytes) {
+  __m256i stop = _mm256_cmpeq_epi8(bytes, _mm256_setzero_si256());
+  for (const char ch : {'"', '\\', '\n'})
+    stop =
+        _mm256_or_si256(stop, _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(ch)));
+  return _mm256_xor_si256(stop, _mm256_set1_epi8(-1));
+}
+
+ALTA_AVX2 __m256i comment_avx2(__m256i bytes) {
+  __m256i stop = _mm256_cmpeq_epi8(bytes, _mm256_setzero_si256());
+  for (const char ch : {'*', '/'})
+    stop =
+        _mm256_or_si256(stop, _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(ch)));
+  return _mm256_xor_si256(stop, _mm256_set1_epi8(-1));
+}
+
+#undef ALTA_SSE2
+#undef ALTA_AVX2
+
+template <__m128i (*classify)(__m128i)>
+__attribute__((target("sse2"))) size_t span_sse2(const char *data) {
+  for (size_t i = 0;; i += 16) {
+    const __m128i block =
+        _mm_loadu_si128(reinterpret_cast<const __m128i *>(data + i));
+    const auto mask = static_cast<uint32_t>(_mm_movemask_epi8(classify(block)));
+    if (mask != 0xffff)
+      return i + std::countr_one(mask);
+  }
+}
+
+template <__m256i (*classify)(__m256i)>
+__attribute__((target("avx2"))) size_t span_avx2(const char *data) {
+  for (size_t i = 0;; i += 32) {
+    const __m256i block =
+        _mm256_loadu_si256(reinterpret_cast<const __m256i *>(data + i));
+    const auto mask =
+        static_cast<uint32_t>(_mm256_movemask_epi8(classify(block)));
+    if (mask != 0xffffffff)
+      return i + std::countr_one(mask);
+  }
+}
+
+#endif
+
+/// Picks the implementation of one scanner for the active instruction set.
+template <bool (*accept)(char)
+#ifdef ALTA_SIMD_X86
+          ,
+          __m128i (*classify_sse2)(__m128i), __m256i (*classify_avx2)(__m256i)
+#endif
+          >
+size_t span(const char *data) {
+#ifdef ALTA_SIMD_X86
+  switch (simd::active_level()) {
+  case simd::Level::AVX2:
+    return span_avx2<classify_avx2>(data);
+  case simd::Level::SSE2:
+    return span_sse2<classify_sse2>(data);
+  default:
+    break;
+  }
+#endif
+  return span_scalar<accept>(data);
+}
+
+} // namespace
+
+/* -------------------------------------------------------------------------- */
+/* PUBLIC ENTRY POINTS */
+/* -------------------------------------------------------------------------- */
+
+#ifdef ALTA_SIMD_X86
+#define CLASSIFIERS(name) , name##_sse2, name##_avx2
+#else
+#define CLASSIFIERS(name)
+#endif
+
+size_t span_whitespace(const char *data) {
+  return span<is_whitespace CLASSIFIERS(whitespace)>(data);
+}
+
+size_t span_identifier(const char *data) {
+  return span<is_ident_cont CLASSIFIERS(identifier)>(data);
+}
+
+size_t span_digits(const char *data) {
+  return span<is_digit CLASSIFIERS(digits)>(data);
+}
+
+size_t span_string(const char *data) {
+  return span<is_string_body CLASSIFIERS(string)>(data);
+}
+
+size_t span_comment(const char *data) {
+  return span<is_comment_body CLASSIFIERS(comment)>(data);
+}
+
+#undef CLASSIFIERS
+
+}; // namespace scan
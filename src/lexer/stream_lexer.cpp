@@ -0,0 +1,160 @@
+#include "lexer/stream_lexer.hpp"
+#include "common/diagnostic.hpp"
+#include "common/span.hpp"
+#include "common/stream_source.hpp"
+#include "lexer/lexer.hpp"
+#include "lexer/token.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <expected>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <utility>
+
+StreamLexer::StreamLexer(std::string path, TokenSink on_token,
+                         DiagnosticSink on_diagnostic, size_t error_limit)
+    : path(std::move(path)), on_token(std::move(on_token)),
+      on_diagnostic(std::move(on_diagnostic)), carry(),
+      position{.offset = 0, .line = 1, .column = 1}, error_limit(error_limit),
+      errors(0), stopped(false), reported_encoding(false) {}
+
+StreamPosition StreamLexer::locate(const Source &window, size_t offset) const {
+  const auto line = window.line_of(offset);
+  const auto column = window.column_of(offset);
+  return StreamPosition{
+      .offset = position.offset + offset,
+      .line = position.line + line - 1,
+      .column = line == 1 ? position.column + column - 1 : column,
+  };
+}
+
+/// Whether `issue` reports something that more input could still close.
+bool is_unterminated(Diagnostic::Issue issue) {
+  return issue == Diagnostic::Issue::UnterminatedString ||
+         issue == Diagnostic::Issue::UnterminatedComment;
+}
+
+void StreamLexer::lex_window(bool final) {
+  const Source window(std::move(carry), path);
+  TokenCollect tokens(window, true);
+  // Every window with invalid UTF-8 reports it, but only the first report is
+  // handed out, so the others don't count towards the limit
+  const size_t repeated = reported_encoding && window.invalid_utf8.has_value();
+  DiagCollect diagnostics(error_limit == 0 ? 0
+                                           : error_limit - errors + repeated);
+  Lexer lexer(window, tokens, diagnostics);
+  lexer.lex();
+
+  // A diagnostic that runs up to the end of the window, like an unterminated
+  // string, could still go away. Otherwise, once the error limit is reached
+  // nothing past the error that reached it is lexed, so the window is the
+  // last one.
+  size_t boundary = window.size;
+  for (const auto &diag : diagnostics) {
+    const size_t start = diag.span.offset - window.base;
+    const size_t end = start + diag.span.length;
+    if (!final && is_unterminated(diag.issue) &&
+        end + MAX_LOOKAHEAD > window.size)
+      boundary = std::min(boundary, start);
+  }
+  stopped = !final && diagnostics.limit_reached() && boundary == window.size;
+  final |= stopped;
+
+  // Everything before the first token that could still grow is settled, and
+  // the comments in front of that token are carried along with it, since the
+  // last of them may not be over yet. The EOF token only counts once the
+  // stream has really ended.
+  for (size_t i = 0; i < tokens.size(); ++i) {
+    const auto token = tokens[i];
+    const size_t start = token.span.offset - window.base;
+    const size_t end = start + token.span.length;
+    if (!final && (token.kind == Token::Kind::Eof ||
+                   end + MAX_LOOKAHEAD > window.size)) {
+      const auto comments = tokens.trivia(i);
+      boundary = std::min(boundary, comments.empty()
+                                        ? start
+                                        : comments.front().offset -
+                                              window.base);
+      break;
+    }
+  }
+
+  // A run of errors reaching the end of the window could still grow, and one
+  // ending right where the next window starts could still be coalesced with
+  // one at the start of that window, so either is carried too, unless that
+  // would carry more than `MAX_CARRIED_RUN` bytes: a long run of invalid
+  // bytes would be lexed again with every chunk. The encoding is only
+  // reported once, so it is never coalesced.
+  const auto carries = [&](size_t start) {
+    return !final && window.size - start <= MAX_CARRIED_RUN;
+  };
+  for (const auto &diag : diagnostics) {
+    const size_t start = diag.span.offset - window.base;
+    const size_t end = start + diag.span.length;
+    if (carries(start) && end + MAX_LOOKAHEAD > window.size)
+      boundary = std::min(boundary, start);
+  }
+  for (const auto &diag : diagnostics) {
+    const size_t start = diag.span.offset - window.base;
+    if (carries(start) && diag.issue != Diagnostic::Issue::InvalidEncoding &&
+        start < boundary && start + diag.span.length == boundary)
+      boundary = start;
+  }
+
+  // Diagnostics come out ahead of the tokens of their window so they are seen
+  // before anything that depends on them
+  for (const auto &diag : diagnostics) {
+    const size_t offset = diag.span.offset - window.base;
+    if (!final && offset >= boundary)
+      continue;
+    if (diag.issue == Diagnostic::Issue::InvalidEncoding) {
+      if (reported_encoding)
+        continue;
+      reported_encoding = true;
+    }
+    if (diag.level == Diagnostic::Level::Error)
+      ++errors;
+    on_diagnostic(diag, locate(window, offset));
+  }
+  // The EOF token of a stream that stopped early still goes at its very end,
+  // which `finish()` hands out once it is known
+  for (const auto token : tokens) {
+    const size_t offset = token.span.offset - window.base;
+    if ((!final && offset >= boundary) ||
+        (stopped && token.kind == Token::Kind::Eof))
+      break;
+    on_token(token, locate(window, offset));
+  }
+
+  if (!final || stopped) {
+    const auto next = locate(window, boundary);
+    carry = std::string(window.content.substr(boundary));
+    position = next;
+  }
+}
+
+void StreamLexer::feed(std::string_view chunk) {
+  if (stopped) {
+    // Only the position is kept track of past the error limit
+    const Source skipped{std::string(chunk), path};
+    position = locate(skipped, skipped.size);
+    return;
+  }
+  carry.append(chunk);
+  lex_window(false);
+}
+
+void StreamLexer::finish() { lex_window(true); }
+
+std::expected<void, std::error_code> StreamLexer::lex(StreamSource &stream) {
+  while (!stream.at_end()) {
+    const auto chunk = stream.next();
+    if (!chunk.has_value())
+      return std::unexpected(chunk.error());
+    if (!chunk->empty())
+      feed(chunk.value());
+  }
+  finish();
+  return {};
+}
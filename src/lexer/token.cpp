@@ -1,30 +1,159 @@
 #include "lexer/token.hpp"
 #include "common/span.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
 
-Token::Token(Kind kind, Span span) : kind(kind), span(span) {}
+Token::Token(Kind kind, Span span, Symbol symbol)
+    : kind(kind), symbol(symbol), span(span) {}
 
 /* -------------------------------------------------------------------------- */
 /* COLLECTION IMPLEMENTATION */
 /* -------------------------------------------------------------------------- */
 
-TokenCollect::TokenCollect(const Source &source) : source(source), items({}) {
-  items.reserve(INIT_TOKEN_RESERVE_SIZE);
+TokenCollect::TokenCollect(const Source &source, bool keep_trivia)
+    : source(&source), keep_trivia(keep_trivia) {
+  kinds.reserve(INIT_TOKEN_RESERVE_SIZE);
+  offsets.reserve(INIT_TOKEN_RESERVE_SIZE);
+  lengths.reserve(INIT_TOKEN_RESERVE_SIZE);
+  symbols.reserve(INIT_TOKEN_RESERVE_SIZE);
 }
 
-const std::vector<Token> &TokenCollect::data() const { return items; }
-auto TokenCollect::begin() const { return items.begin(); }
-auto TokenCollect::end() const { return items.end(); }
-size_t TokenCollect::size() const { return items.size(); }
-Token TokenCollect::eof() const { return items.back(); }
-void TokenCollect::push(const Token &token) { items.push_back(token); }
+TokenCollect::const_iterator TokenCollect::begin() const {
+  return const_iterator(this, 0);
+}
+TokenCollect::const_iterator TokenCollect::end() const {
+  return const_iterator(this, size());
+}
+size_t TokenCollect::size() const { return kinds.size(); }
+Token TokenCollect::eof() const { return (*this)[size() - 1]; }
+
+uint32_t TokenCollect::length(size_t index) const {
+  if (lengths[index] != LONG_LENGTH)
+    return lengths[index];
+
+  // Long tokens are pushed in order, so their lengths are sorted by index
+  const auto found = std::lower_bound(
+      long_lengths.begin(), long_lengths.end(), index,
+      [](const auto &entry, size_t index) { return entry.first < index; });
+  return found->second;
+}
+
+Token TokenCollect::operator[](size_t index) const {
+  return Token(kinds[index],
+               Span(source->base + offsets[index], length(index)),
+               symbols[index]);
+}
+
+void TokenCollect::push(const Token &token) {
+  if (token.span.length >= LONG_LENGTH)
+    long_lengths.emplace_back(static_cast<uint32_t>(size()), token.span.length);
+  kinds.push_back(token.kind);
+  offsets.push_back(token.span.offset - source->base);
+  lengths.push_back(static_cast<uint8_t>(
+      std::min<uint32_t>(token.span.length, LONG_LENGTH)));
+  symbols.push_back(token.symbol);
+}
+
+void TokenCollect::push_trivia(const Span &comment) {
+  if (keep_trivia)
+    comments.emplace_back(comment.offset - source->base, comment.length);
+}
+
+std::vector<Span> TokenCollect::trivia(size_t index) const {
+  const uint32_t from = index == 0 ? 0 : offsets[index - 1] + length(index - 1);
+  const auto first = std::lower_bound(
+      comments.begin(), comments.end(), from,
+      [](const auto &comment, uint32_t from) { return comment.first < from; });
+
+  std::vector<Span> found;
+  for (auto it = first; it != comments.end() && it->first < offsets[index];
+       ++it)
+    found.emplace_back(source->base + it->first, it->second);
+  return found;
+}
+
+void TokenCollect::clear() {
+  kinds.clear();
+  offsets.clear();
+  lengths.clear();
+  long_lengths.clear();
+  symbols.clear();
+  comments.clear();
+}
+
+void TokenCollect::append(const TokenCollect &other) {
+  assert(other.source == source);
+  const auto shift = static_cast<uint32_t>(size());
+  for (const auto &[index, length] : other.long_lengths)
+    long_lengths.emplace_back(index + shift, length);
+  comments.insert(comments.end(), other.comments.begin(), other.comments.end());
+  kinds.insert(kinds.end(), other.kinds.begin(), other.kinds.end());
+  offsets.insert(offsets.end(), other.offsets.begin(), other.offsets.end());
+  lengths.insert(lengths.end(), other.lengths.begin(), other.lengths.end());
+  symbols.insert(symbols.end(), other.symbols.begin(), other.symbols.end());
+}
+
+void TokenCollect::splice(size_t first, size_t last,
+                          const TokenCollect &replacement,
+                          std::ptrdiff_t shift) {
+  assert(first <= last && last <= size());
+  const auto added = static_cast<std::ptrdiff_t>(replacement.size()) -
+                     static_cast<std::ptrdiff_t>(last - first);
+
+  // The comments between the tokens around the replaced ones are replaced
+  // too, and those after them move
+  const uint32_t from = first == 0 ? 0 : offsets[first - 1] + length(first - 1);
+  const uint32_t to = last < size() ? offsets[last] : UINT32_MAX;
+  std::vector<std::pair<uint32_t, uint32_t>> kept;
+  for (const auto &comment : comments)
+    if (comment.first < from)
+      kept.push_back(comment);
+  kept.insert(kept.end(), replacement.comments.begin(),
+              replacement.comments.end());
+  for (const auto &[offset, length] : comments)
+    if (offset >= to)
+      kept.emplace_back(static_cast<uint32_t>(offset + shift), length);
+  comments = std::move(kept);
+
+  // Later tokens move along with the text after the edit
+  for (size_t i = last; i < size(); ++i)
+    offsets[i] = static_cast<uint32_t>(offsets[i] + shift);
+
+  const auto replace = [&](auto &items, const auto &with) {
+    items.erase(items.begin() + first, items.begin() + last);
+    items.insert(items.begin() + first, with.begin(), with.end());
+  };
+  replace(kinds, replacement.kinds);
+  replace(offsets, replacement.offsets);
+  replace(lengths, replacement.lengths);
+  replace(symbols, replacement.symbols);
+
+  // The long lengths stay sorted by index: those before the replaced tokens,
+  // then the replacement's, then those after, renumbered
+  std::vector<std::pair<uint32_t, uint32_t>> spliced;
+  for (const auto &[index, length] : long_lengths)
+    if (index < first)
+      spliced.emplace_back(index, length);
+  for (const auto &[index, length] : replacement.long_lengths)
+    spliced.emplace_back(index + first, length);
+  for (const auto &[index, length] : long_lengths)
+    if (index >= last)
+      spliced.emplace_back(index + added, length);
+  long_lengths = std::move(spliced);
+
+  source = replacement.source;
+}
 
 void TokenCollect::print_all() const {
-  std::cout << "Printing tokens for file: `" << source.path
+  std::cout << "Printing tokens for file: `" << source->path
             << "`:" << std::endl;
 
   // Print each token
   unsigned i = 0;
-  for (auto &t : *this) {
+  for (const auto t : *this) {
     std::cout << "  " << i << ": " << t << "\n";
     ++i;
   }
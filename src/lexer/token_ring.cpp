@@ -0,0 +1,99 @@
+#include "lexer/token_ring.hpp"
+#include "lexer/token.hpp"
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+
+/// The low bit of `TokenRing::published`, set along with the last batch.
+constexpr size_t ENDED = 1;
+
+TokenRing::TokenRing(size_t batches)
+    : slots(batches), published(0), released(0), first(0) {
+  // The consumer looks at the last published batch while the producer fills
+  // the next one, so they must not share a slot
+  assert(batches >= 2);
+}
+
+/* -------------------------------------------------------------------------- */
+/* PRODUCER */
+/* -------------------------------------------------------------------------- */
+
+void TokenRing::publish(TokenCollect &batch) {
+  const size_t state = published.load(std::memory_order_relaxed);
+  const size_t count = state >> 1;
+  assert((state & ENDED) == 0);
+
+  // Wait for the consumer to free the oldest slot if every slot is taken
+  size_t freed = released.load(std::memory_order_acquire);
+  while (count - freed == slots.size()) {
+    released.wait(freed, std::memory_order_acquire);
+    freed = released.load(std::memory_order_acquire);
+  }
+
+  // Tokens can't be assigned, so the slot is refilled in place, keeping the
+  // capacity it grew to
+  auto &slot = slots[count % slots.size()];
+  slot.clear();
+  for (const auto token : batch)
+    slot.push_back(token);
+  batch.clear();
+
+  const bool ended = !slot.empty() && slot.back().kind == Token::Kind::Eof;
+  published.store((count + 1) << 1 | (ended ? ENDED : 0),
+                  std::memory_order_release);
+  published.notify_one();
+}
+
+/* -------------------------------------------------------------------------- */
+/* CONSUMER */
+/* -------------------------------------------------------------------------- */
+
+Token TokenRing::at(size_t index) {
+  assert(index >= first);
+
+  size_t batch = released.load(std::memory_order_relaxed);
+  size_t start = first;
+  while (true) {
+    const size_t state = published.load(std::memory_order_acquire);
+    const size_t count = state >> 1;
+    if (batch == count) {
+      // Once the stream has ended nothing writes to the slots anymore, so the
+      // last batch can be read even if it was released
+      if ((state & ENDED) != 0)
+        return slots[(count - 1) % slots.size()].back();
+      published.wait(state, std::memory_order_acquire);
+      continue;
+    }
+
+    const auto &slot = slots[batch % slots.size()];
+    if (index - start < slot.size())
+      return slot[index - start];
+    start += slot.size();
+    ++batch;
+  }
+}
+
+void TokenRing::release(size_t index) {
+  const size_t count = published.load(std::memory_order_acquire) >> 1;
+  const size_t before = released.load(std::memory_order_relaxed);
+
+  size_t batch = before;
+  while (batch < count && first + slots[batch % slots.size()].size() <= index) {
+    first += slots[batch % slots.size()].size();
+    ++batch;
+  }
+  if (batch != before) {
+    released.store(batch, std::memory_order_release);
+    released.notify_one();
+  }
+}
+
+void TokenRing::drain() {
+  while (true) {
+    const size_t state = published.load(std::memory_order_acquire);
+    release(static_cast<size_t>(-1));
+    if ((state & ENDED) != 0)
+      return;
+    published.wait(state, std::memory_order_acquire);
+  }
+}
@@ -1,3 +1,94 @@
+#include "common/diagnostic.hpp"
 #include "common/span.hpp"
+#include "common/thread_pool.hpp"
+#include "lexer/lexer.hpp"
+#include "lexer/token.hpp"
+#include "lexer/token_ring.hpp"
+#include "parser/parser.hpp"
+#include <charconv>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <vector>
 
-int main() { return 0; }
\ No newline at end of file
+/// How many errors are reported before compilation stops, unless overridden
+/// with `-ferror-limit=N`, where `0` means there is no limit.
+constexpr size_t DEFAULT_ERROR_LIMIT = 20;
+
+int main(int argc, char **argv) {
+  constexpr std::string_view ERROR_LIMIT_FLAG = "-ferror-limit=";
+  constexpr std::string_view PIPELINE_FLAG = "-fpipeline";
+
+  size_t error_limit = DEFAULT_ERROR_LIMIT;
+  bool pipeline = false;
+  std::vector<std::string> paths;
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    if (arg == PIPELINE_FLAG) {
+      pipeline = true;
+      continue;
+    }
+    if (!arg.starts_with(ERROR_LIMIT_FLAG)) {
+      paths.emplace_back(arg);
+      continue;
+    }
+
+    const auto value = arg.substr(ERROR_LIMIT_FLAG.size());
+    const auto end = value.data() + value.size();
+    const auto [last, ec] = std::from_chars(value.data(), end, error_limit);
+    if (ec != std::errc() || last != end || value.empty()) {
+      std::cerr << "alta: invalid error limit '" << value << "'\n";
+      return 2;
+    }
+  }
+  if (paths.empty()) {
+    std::cerr << "usage: alta [-ferror-limit=N] [-fpipeline] <file>...\n";
+    return 2;
+  }
+
+  // Sources are kept alive until the diagnostics pointing into them are printed
+  DiagCollect diagnostics(error_limit);
+  ThreadPool pool;
+  std::vector<std::unique_ptr<Source>> sources;
+  for (const auto &path : paths) {
+    if (diagnostics.limit_reached())
+      break;
+
+    auto source = Source::map(path);
+    if (!source.has_value()) {
+      std::cerr << "alta: cannot read '" << path
+                << "': " << source.error().message() << "\n";
+      return 2;
+    }
+    sources.push_back(std::move(source.value()));
+
+    // Consume the tokens while the lexer is still running on its own thread.
+    // The parser releases batches as it reads them, and draining covers a
+    // parser that stops before the end
+    if (pipeline) {
+      TokenRing ring;
+      std::jthread lexing([&] {
+        TokenCollect batch(*sources.back());
+        Lexer lexer(*sources.back(), batch, diagnostics);
+        lexer.lex(ring);
+      });
+      Parser parser(*sources.back(), ring, diagnostics);
+      parser.parse();
+      ring.drain();
+      continue;
+    }
+
+    TokenCollect tokens(*sources.back());
+    Lexer lexer(*sources.back(), tokens, diagnostics);
+    lexer.lex(pool);
+    Parser parser(*sources.back(), tokens, diagnostics);
+    parser.parse();
+  }
+
+  if (diagnostics.size() != 0)
+    diagnostics.print_all(std::cerr);
+  return diagnostics.error_count() == 0 ? 0 : 1;
+}
@@ -1,64 +1,70 @@
 #include "parser/parser.hpp"
 #include "common/diagnostic.hpp"
 #include "common/span.hpp"
+#include "lexer/lexer.hpp"
 #include "lexer/token.hpp"
+#include "lexer/token_ring.hpp"
 #include "parser/ast.hpp"
 #include <cstdint>
-#include <expected>
 #include <optional>
 #include <string_view>
 
-/* -------------------------------------------------------------------------- */
-/* PARSER HELPERS */
-/* -------------------------------------------------------------------------- */
-
-std::expected<int32_t, Diagnostic> parse_int32(const std::string_view &str,
-                                               Span span) {
-  try {
-    int32_t num = std::stoi(std::string(str));
-    return num;
-  } catch (...) {
-    std::unexpected(Diagnostic(Diagnostic::Issue::InternalError, span,
-                               "Invalid integer literal."));
-  }
-  return 0;
-}
-
-std::expected<double, Diagnostic> parse_float(const std::string_view &str,
-                                              Span span) {
-  try {
-    double num = std::stod(std::string(str));
-    return num;
-  } catch (...) {
-    std::unexpected(Diagnostic(Diagnostic::Issue::InternalError, span,
-                               "Invalid floating point literal."));
-  }
-  return 0;
-}
-
 /* -------------------------------------------------------------------------- */
 /* PARSER IMPLEMENTATION */
 /* -------------------------------------------------------------------------- */
 
 Parser::Parser(const Source &source, const TokenCollect &tokens,
                DiagCollect &diagnostics)
-    : source(source), tokens(tokens), diagnostics(diagnostics), cursor(0) {}
+    : source(source), tokens(&tokens), ring(nullptr),
+      diagnostics(diagnostics), cursor(0) {}
+
+Parser::Parser(const Source &source, TokenRing &ring,
+               DiagCollect &diagnostics)
+    : source(source), tokens(nullptr), ring(&ring), diagnostics(diagnostics),
+      cursor(0) {}
 
 bool Parser::is_at_end(const unsigned k) {
-  if (cursor + k >= tokens.size()) {
+  if (ring != nullptr) {
+    return ring->at(cursor + k).kind == Token::Kind::Eof;
+  }
+  if (cursor + k >= tokens->size()) {
     return true;
   }
   return false;
 }
 Token Parser::peek(const unsigned k) {
+  if (ring != nullptr) {
+    return ring->at(cursor + k);
+  }
   if (is_at_end(k)) {
-    return tokens.eof();
+    return tokens->eof();
   }
-  return tokens.data()[cursor + k];
+  return (*tokens)[cursor + k];
 }
 Token Parser::current() { return peek(0); }
+Token::Kind Parser::peek_kind(const unsigned k) {
+  if (ring != nullptr) {
+    return ring->at(cursor + k).kind;
+  }
+  if (is_at_end(k)) {
+    return Token::Kind::Eof;
+  }
+  return tokens->kind(cursor + k);
+}
+void Parser::eat(const unsigned k) {
+  cursor += k;
+  if (ring != nullptr) {
+    ring->release(cursor);
+  }
+}
 
-void Parser::parse() { return; }
+void Parser::parse() {
+  // Only expressions have a grammar so far, so the stream is just walked to
+  // its end, releasing each batch of a ring once it is behind the cursor
+  while (peek_kind(0) != Token::Kind::Eof) {
+    eat();
+  }
+}
 
 /* -------------------------------------------------------------------------- */
 /* EXPRESSION PARSERS */
@@ -66,7 +72,13 @@ void Parser::parse() { return; }
 
 // Top level parse_expr() method points to the highest level precedence
 // expression parser.
-std::optional<ast::Node> Parser::parse_expr() { return parse_primary(); }
+std::optional<ast::Node> Parser::parse_expr() {
+  // Nothing more gets reported once the error limit is reached
+  if (diagnostics.limit_reached()) {
+    return std::nullopt;
+  }
+  return parse_primary();
+}
 
 std::optional<ast::Node> Parser::parse_primary() {
   using enum Token::Kind;
@@ -75,33 +87,25 @@ std::optional<ast::Node> Parser::parse_primary() {
 
   switch (token.kind) {
 
-  // Integer parsing and conversion
-  case Integer: {
-    const auto value = parse_int32(token.span.lexeme(), token.span);
-    if (value.has_value()) {
-      return ast::Node(ast::Kind::Int, ast::Data{.node_int = {value.value()}},
-                       token.span);
-    }
-    diagnostics.push(value.error());
-    return std::nullopt;
-  }
+  // Integers are converted by the lexer, which also reports any too large
+  case Integer:
+    return ast::Node(ast::Kind::Int, ast::Data{.node_int = {token.integer()}},
+                     token.span);
 
-  // Floating point parsing and conversion
+  // Floating point conversion, where the lexer has already reported a literal
+  // too large for a double
   case Decimal: {
-    const auto value = parse_float(token.span.lexeme(), token.span);
-    if (value.has_value()) {
-      return ast::Node(ast::Kind::Float,
-                       ast::Data{.node_float = {value.value()}}, token.span);
-    }
-    diagnostics.push(value.error());
-    return std::nullopt;
+    const auto value = decode_decimal(source, token);
+    if (!value.has_value())
+      return std::nullopt;
+    return ast::Node(ast::Kind::Float, ast::Data{.node_float = {value.value()}},
+                     token.span);
   }
 
   // If none of those matched then throw the infamous 'expected expression'
   // error
   default: {
-    const Diagnostic diag(Diagnostic::Issue::ExpectedExpression, token.span,
-                          "Expected an expression here.");
+    const Diagnostic diag(Diagnostic::Issue::ExpectedExpression, token.span);
     diagnostics.push(diag);
     return std::nullopt;
   }
@@ -5,14 +5,36 @@
 
 #include "common/diagnostic.hpp"
 #include "common/operator.hpp"
+#include "common/simd.hpp"
+#include "common/source_loader.hpp"
+#include "common/source_manager.hpp"
 #include "common/span.hpp"
+#include "common/stream_source.hpp"
+#include "common/symbol_table.hpp"
+#include "common/thread_pool.hpp"
 #include "lexer/lexer.hpp"
+#include "lexer/scan.hpp"
+#include "lexer/stream_lexer.hpp"
 #include "lexer/token.hpp"
+#include "lexer/token_ring.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <atomic>
+#include <filesystem>
+#include <fstream>
 #include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include <unistd.h>
+
 /* -------------------------------------------------------------------------- */
 /* STRING STREAM HELPERS */
 /* -------------------------------------------------------------------------- */
@@ -57,6 +79,18 @@ TEST_CASE("Span line numbers, column numbers, and lexemes") {
     CHECK(span.line_number() == 3);
     CHECK(span.lexeme() == "3");
   }
+
+  // Given the source, without looking it up, and only if the span is in it
+  const Source other("Line 4");
+  for (const size_t offset : {0, 7, 19}) {
+    const Span span(src, offset, 1);
+    CHECK(span.line_number(src) == span.line_number());
+    CHECK(span.column_number(src) == span.column_number());
+    CHECK(span.lexeme(src) == span.lexeme());
+    CHECK_FALSE(span.line_number(other).has_value());
+    CHECK_FALSE(span.column_number(other).has_value());
+    CHECK(span.lexeme(other).empty());
+  }
 }
 
 TEST_CASE("Source line fetching") {
@@ -70,6 +104,97 @@ TEST_CASE("Source line fetching") {
   CHECK(src.line(3) == "Line 3");
 }
 
+TEST_CASE("Source line-start index") {
+  std::string raw_text = "ab\n"  // 0..2
+                         "\n"    // 3
+                         "cd\n"; // 4..6
+  const Source src(raw_text);
+
+  CHECK(src.line_starts == std::vector<uint32_t>{0, 3, 4, 7});
+  CHECK(src.line_of(0) == 1);
+  CHECK(src.line_of(2) == 1);
+  CHECK(src.line_of(3) == 2);
+  CHECK(src.line_of(6) == 3);
+  CHECK(src.line(2) == "\n");
+  CHECK(src.line(4) == "");
+  CHECK(src.line(5) == "");
+
+  // Newlines belong to the line they terminate
+  const Span newline(src, 6, 1);
+  CHECK(newline.line_number() == 3);
+  CHECK(newline.column_number() == 3);
+
+  // Long enough to go through the vectorized scan and its scalar tail
+  std::string long_text;
+  for (int i = 0; i < 100; ++i)
+    long_text += std::string(static_cast<size_t>(i % 7), 'x') + "\n";
+  const Source long_src(long_text);
+  CHECK(long_src.line_starts.size() == 101);
+  for (size_t ln = 1; ln <= 100; ++ln) {
+    const auto start = long_src.line_start(ln);
+    CHECK(long_src.line_of(start) == ln);
+    CHECK(long_src.line(ln).size() == (ln - 1) % 7 + 1);
+  }
+}
+
+TEST_CASE("UTF-8 validation and codepoint columns") {
+  const Source ascii("abc\ndef");
+  CHECK(ascii.ascii);
+  CHECK_FALSE(ascii.invalid_utf8.has_value());
+
+  // "é" is two bytes and "€" three, but each is one column
+  const Source text("x := \"\xC3\xA9\xE2\x82\xAC\" + \xC3\xA9t\xC3\xA9");
+  CHECK_FALSE(text.ascii);
+  CHECK_FALSE(text.invalid_utf8.has_value());
+  CHECK(Span(text, 13, 1).column_number() == 11);
+  CHECK(Span(text, 15, 5).column_number() == 13);
+  CHECK(Span(text, 15, 5).lexeme() == "\xC3\xA9t\xC3\xA9");
+
+  // Overlong encodings, surrogates and truncated sequences are all rejected
+  CHECK(Source("ab\xC0\xAF").invalid_utf8 == 2);
+  CHECK(Source("\xED\xA0\x80").invalid_utf8 == 0);
+  CHECK(Source("\xF4\x90\x80\x80").invalid_utf8 == 0);
+  CHECK(Source(std::string(40, 'a') + "\xE2\x82").invalid_utf8 == 40);
+  CHECK(Source(std::string(70, 'a') + "\x80" + std::string(70, 'a'))
+            .invalid_utf8 == 70);
+}
+
+TEST_CASE("Memory-mapped sources") {
+  const auto dir = std::filesystem::temp_directory_path();
+  const auto path = (dir / "alta_mapped_source.alta").string();
+  {
+    std::ofstream file(path, std::ios::binary);
+    file << "a := 1\nb := 2";
+  }
+
+  const auto mapped = Source::map(path);
+  REQUIRE(mapped.has_value());
+  const Source &src = *mapped.value();
+  CHECK(src.path == path);
+  CHECK(src.size == 13);
+  CHECK(src.content == "a := 1\nb := 2");
+  CHECK(src.content.data()[src.size] == '\0');
+  CHECK(src.line(2) == "b := 2");
+
+  // A file filling whole pages still has readable padding past EOF
+  {
+    std::ofstream file(path, std::ios::binary);
+    file << std::string(4096 * 2, 'x');
+  }
+  const auto full = Source::map(path);
+  REQUIRE(full.has_value());
+  CHECK(full.value()->size == 4096 * 2);
+  for (size_t i = 0; i < SOURCE_PADDING; ++i)
+    CHECK(full.value()->content.data()[full.value()->size + i] == '\0');
+
+  std::filesystem::remove(path);
+  CHECK_FALSE(Source::map(path).has_value());
+
+  // Owned sources carry the same padding
+  const Source owned("abc");
+  CHECK(owned.content.data()[owned.size] == '\0');
+}
+
 TEST_CASE("Span buffer load operator overload") {
   std::string raw_text = "Line 1\n" // 6
                          "Line 2\n" // 13
@@ -86,6 +211,150 @@ TEST_CASE("Span buffer load operator overload") {
   }
 }
 
+TEST_CASE("Source manager offset ranges") {
+  auto &manager = SourceManager::global();
+  const auto registered = manager.size();
+
+  const Source a("first");
+  std::optional<Source> b(std::in_place, "second source");
+  CHECK(manager.size() == registered + 2);
+
+  // Ranges cover the content plus the EOF position and never overlap
+  CHECK(manager.find(a.base) == &a);
+  CHECK(manager.find(a.base + a.size) == &a);
+  CHECK(manager.find(b->base + b->size) == &b.value());
+  CHECK((a.base + a.size < b->base || b->base + b->size < a.base));
+
+  const Span span(*b, 7, 6);
+  CHECK(span.source() == &b.value());
+  CHECK(span.lexeme() == "source");
+  CHECK(span.column_number() == 8);
+
+  // Spans are plain values that can be reassigned
+  Span copy(a, 0, 1);
+  copy = span;
+  CHECK(copy.offset == span.offset);
+
+  // Spans into a destroyed source no longer resolve
+  b.reset();
+  CHECK(manager.size() == registered + 1);
+  CHECK(span.source() == nullptr);
+  CHECK(span.lexeme().empty());
+  CHECK_FALSE(span.line_number().has_value());
+
+  auto ss = sstream_new();
+  ss << span;
+  CHECK(ss.str().find("<unknown>") != std::string::npos);
+
+  // Freed ranges aren't handed out again while there is space past the last
+  // one, so the span still doesn't resolve once another source is added
+  const Source c("second source");
+  CHECK(c.base > span.offset);
+  CHECK(span.source() == nullptr);
+  CHECK(manager.find(c.base) == &c);
+}
+
+/* -------------------------------------------------------------------------- */
+/* COMMON/SYMBOL_TABLE */
+/* -------------------------------------------------------------------------- */
+
+TEST_CASE("Symbol tables intern names concurrently") {
+  SymbolTable table;
+  const auto a = table.intern("alpha");
+  CHECK(a != NO_SYMBOL);
+  CHECK(table.intern("alpha") == a);
+  CHECK(table.intern("alpha", SymbolTable::hash("alpha")) == a);
+  CHECK(table.intern("beta") != a);
+  CHECK(table.name(a) == "alpha");
+  CHECK(table.find("alpha") == a);
+  CHECK_FALSE(table.find("gamma").has_value());
+
+  // Names are copied, so they outlive the buffer they were interned from
+  {
+    const std::string temporary(1000, 'y');
+    CHECK(table.name(table.intern(temporary)) == temporary);
+  }
+  CHECK(table.find(std::string(1000, 'y')).has_value());
+
+  // Threads interning overlapping names, enough to grow every shard several
+  // times, agree on every symbol
+  constexpr size_t NAMES = 20000;
+  ThreadPool pool(4);
+  std::vector<std::vector<Symbol>> seen(8, std::vector<Symbol>(NAMES));
+  pool.run(seen.size(), [&](size_t thread) {
+    for (size_t i = 0; i < NAMES; ++i) {
+      const auto index = (i * 7919 + thread * 1009) % NAMES;
+      seen[thread][index] = table.intern("name_" + std::to_string(index));
+    }
+  });
+  for (size_t i = 0; i < NAMES; ++i) {
+    const auto name = "name_" + std::to_string(i);
+    CHECK(table.name(seen[0][i]) == name);
+    for (const auto &symbols : seen)
+      CHECK(symbols[i] == seen[0][i]);
+  }
+}
+
+/* -------------------------------------------------------------------------- */
+/* COMMON/SOURCE_LOADER */
+/* -------------------------------------------------------------------------- */
+
+TEST_CASE("Thread pool runs every iteration once") {
+  ThreadPool pool(4);
+  CHECK(pool.size() == 4);
+
+  for (const size_t count : {0, 1, 3, 1000}) {
+    std::vector<std::atomic<int>> hits(count);
+    pool.run(count, [&](size_t i) { hits[i].fetch_add(1); });
+    for (const auto &hit : hits)
+      CHECK(hit.load() == 1);
+  }
+}
+
+TEST_CASE("Batched source loading") {
+  const auto dir =
+      std::filesystem::temp_directory_path() / "alta_source_loader";
+  std::filesystem::create_directories(dir);
+
+  std::vector<std::string> paths;
+  for (int i = 0; i < 300; ++i) {
+    const auto path = (dir / ("unit" + std::to_string(i) + ".alta")).string();
+    std::ofstream file(path, std::ios::binary);
+    file << std::string(static_cast<size_t>(i), 'a' + i % 26);
+    paths.push_back(path);
+  }
+  paths.push_back((dir / "missing.alta").string());
+
+  for (const auto backend : {SourceLoader::Backend::IoUring,
+                             SourceLoader::Backend::ThreadPool}) {
+    const SourceLoader loader(backend, 4);
+    std::mutex lock;
+    std::vector<int> seen(paths.size(), 0);
+    size_t failures = 0;
+
+    loader.load(paths, [&](size_t index, SourceLoader::Result result) {
+      const std::lock_guard guard(lock);
+      ++seen[index];
+      if (!result.has_value()) {
+        ++failures;
+        CHECK(index == paths.size() - 1);
+        return;
+      }
+      const auto &src = *result.value();
+      CHECK(src.path == paths[index]);
+      CHECK(src.size == index);
+      CHECK(src.content == std::string(index, 'a' + index % 26));
+      CHECK(src.content.data()[src.size] == '\0');
+    });
+
+    CHECK(failures == 1);
+    for (const auto count : seen)
+      CHECK(count == 1);
+  }
+
+  std::filesystem::remove_all(dir);
+}
+
 /* -------------------------------------------------------------------------- */
 /* COMMON/DIAGNOSTIC */
 /* -------------------------------------------------------------------------- */
@@ -99,8 +368,7 @@ TEST_CASE("Diagnostic creation and printing") {
 
   {
     const Span span(src, 0, 4);
-    const Diagnostic diag(Diagnostic::Issue::InvalidString, span,
-                          "Something about an error.");
+    const Diagnostic diag(Diagnostic::Issue::InvalidString, span);
     ss << diag;
 
     const auto str = ss.str();
@@ -113,7 +381,7 @@ TEST_CASE("Diagnostic creation and printing") {
   {
     const Span span(src, 7, 1);
     const Diagnostic diag(Diagnostic::Issue::InvalidCharacter, span,
-                          "Something about an error.");
+                          Diagnostic::Arg(span));
     ss << diag;
 
     const auto str = ss.str();
@@ -121,7 +389,177 @@ TEST_CASE("Diagnostic creation and printing") {
     CHECK(str.find("<static>:2:1") != std::string::npos);
     CHECK(str.find("invalid character") != std::string::npos);
     CHECK(str.find("Error:") != std::string::npos);
+    CHECK(str.find("Help: 'L' is not allowed here.") !=
+          std::string::npos);
+  }
+}
+
+TEST_CASE("Diagnostic help messages are formatted from their arguments") {
+  const Source src("a\x01" "b");
+
+  const Diagnostic plain(Diagnostic::Issue::ExpectedExpression,
+                         Span(src, 0, 1));
+  CHECK(plain.message() == "Expected an expression here.");
+
+  const Span control(src, 1, 1);
+  const Diagnostic escaped(Diagnostic::Issue::InvalidCharacter, control,
+                           Diagnostic::Arg(control));
+  CHECK(escaped.message() == "'\\x01' is not allowed here.");
+
+  const Diagnostic text(Diagnostic::Issue::InternalError, Span(src, 2, 1),
+                        Diagnostic::Arg("Invalid integer literal."));
+  CHECK(text.message() == "Invalid integer literal.");
+
+  // Arguments are looked up when rendering, so copies are plain bytes
+  const Diagnostic copy = escaped;
+  CHECK(copy.message() == escaped.message());
+}
+
+TEST_CASE("Batched diagnostic rendering matches individual printing") {
+  const Source a("first line\nsecond line\n\nfourth");
+  const Source b("caf\xC3\xA9 = \xE2\x82\xAC\n  na\xC3\xAFve na\xC3\xAFve");
+  std::optional<Source> dead(std::in_place, "gone");
+  const Span dangling(*dead, 1, 1);
+  dead.reset();
+
+  std::vector<Span> spans = {
+      Span(b, 12, 3), Span(a, 0, 5),   Span(b, 0, 5),  Span(a, 23, 1),
+      Span(a, 12, 6), Span(b, 17, 6),  Span(a, 30, 1), Span(b, 24, 5),
+      Span(a, 6, 40), Span(b, 18, 2),  dangling,       Span(a, 12, 1),
+      Span(b, 9, 1),  Span(a, 24, 1),  Span(b, 27, 1),
+  };
+
+  DiagCollect diagnostics;
+  for (size_t i = 0; i < spans.size(); ++i)
+    diagnostics.push(Diagnostic(i % 2 == 0
+                                    ? Diagnostic::Issue::InvalidCharacter
+                                    : Diagnostic::Issue::ExpectedExpression,
+                                spans[i]));
+
+  auto expected = sstream_new();
+  for (const auto &diag : diagnostics)
+    expected << diag << "\n";
+  expected << std::endl;
+
+  auto rendered = sstream_new();
+  diagnostics.print_all(rendered);
+  CHECK(rendered.str() == expected.str());
+}
+
+TEST_CASE("Concurrent diagnostic collection merges deterministically") {
+  const Source src(std::string(4096, 'x'));
+
+  // Every diagnostic pushed by `threads` workers splitting the work unevenly,
+  // with later phases pushed first so the merge has to reorder them. The
+  // parser errors at the same offset as a lexer error are cascades
+  const auto collect = [&](unsigned threads, DiagCollect &diagnostics) {
+    ThreadPool pool(threads);
+    pool.run(threads, [&](size_t worker) {
+      for (size_t k = 1024; k-- > 0;) {
+        if ((k * 7 + k / 3) % threads != worker)
+          continue;
+        if (k % 5 == 0)
+          diagnostics.push(Diagnostic(Diagnostic::Issue::ExpectedExpression,
+                                      Span(src, 4 * k + 2, 1)));
+        if (k % 3 == 0)
+          diagnostics.push(Diagnostic(Diagnostic::Issue::ExpectedExpression,
+                                      Span(src, 4 * k, 1)));
+        diagnostics.push(Diagnostic(Diagnostic::Issue::InvalidCharacter,
+                                    Span(src, 4 * k, 1)));
+      }
+    });
+  };
+
+  DiagCollect sequential;
+  collect(1, sequential);
+  REQUIRE(sequential.size() == 1024 + 205);
+  CHECK(sequential.error_count() == 1024 + 205 + 342);
+
+  const Diagnostic *last = nullptr;
+  for (const auto &diag : sequential) {
+    if (last != nullptr)
+      CHECK(last->span.offset < diag.span.offset);
+    CHECK(diag.phase() == ((diag.span.offset - src.base) % 4 == 0
+                               ? Diagnostic::Phase::Lexer
+                               : Diagnostic::Phase::Parser));
+    last = &diag;
+  }
+
+  DiagCollect parallel;
+  collect(8, parallel);
+  auto a = sstream_new();
+  auto b = sstream_new();
+  sequential.print_all(a);
+  parallel.print_all(b);
+  CHECK(a.str() == b.str());
+
+  // Workers can poll the limit to stop early, and only the first errors by
+  // position survive the merge
+  DiagCollect limited(100);
+  ThreadPool pool(4);
+  pool.run(4, [&](size_t worker) {
+    for (size_t i = worker; i < 2048 && !limited.limit_reached(); i += 4)
+      limited.push(Diagnostic(Diagnostic::Issue::InvalidCharacter,
+                              Span(src, 2 * i, 1)));
+  });
+  CHECK(limited.limit_reached());
+  CHECK(limited.error_count() < 2048);
+  CHECK(limited.size() == 100);
+}
+
+TEST_CASE("Diagnostic runs are coalesced and cascades suppressed") {
+  const Source src("a = \x01\x02\x03\x04 + \"oops;\n"
+                   "b = $$");
+
+  // A run of invalid characters is reported once, even when the run is
+  // pushed from different threads
+  DiagCollect diagnostics;
+  ThreadPool pool(4);
+  pool.run(4, [&](size_t i) {
+    const Span span(src, 4 + i, 1);
+    diagnostics.push(Diagnostic(Diagnostic::Issue::InvalidCharacter, span,
+                                Diagnostic::Arg(span)));
+  });
+
+  // The parser's errors inside or right after the unterminated string are
+  // caused by it, the one on the next line isn't
+  diagnostics.push(
+      Diagnostic(Diagnostic::Issue::UnterminatedString, Span(src, 11, 6)));
+  diagnostics.push(
+      Diagnostic(Diagnostic::Issue::ExpectedExpression, Span(src, 12, 1)));
+  diagnostics.push(
+      Diagnostic(Diagnostic::Issue::ExpectedExpression, Span(src, 17, 1)));
+  diagnostics.push(
+      Diagnostic(Diagnostic::Issue::ExpectedExpression, Span(src, 22, 1)));
+
+  // Lexer errors sort ahead of a parser error at the same position, which
+  // makes it their cascade
+  for (const size_t offset : {22, 23}) {
+    const Span span(src, offset, 1);
+    diagnostics.push(Diagnostic(Diagnostic::Issue::InvalidCharacter, span,
+                                Diagnostic::Arg(span)));
   }
+
+  std::vector<std::pair<uint32_t, uint32_t>> spans;
+  for (const auto &diag : diagnostics)
+    spans.emplace_back(diag.span.offset - src.base, diag.span.length);
+  const std::vector<std::pair<uint32_t, uint32_t>> expected = {
+      {4, 4}, {11, 6}, {22, 2}};
+  CHECK(spans == expected);
+  CHECK(diagnostics.begin()->message() ==
+        "'\\x01\\x02\\x03\\x04' is not allowed here.");
+
+  // Past the limit only the first errors by position are kept, however they
+  // were pushed, and those dropped still suppress their cascades
+  DiagCollect limited(1);
+  limited.push(
+      Diagnostic(Diagnostic::Issue::ExpectedExpression, Span(src, 12, 1)));
+  limited.push(
+      Diagnostic(Diagnostic::Issue::UnterminatedString, Span(src, 11, 6)));
+  limited.push(
+      Diagnostic(Diagnostic::Issue::InvalidCharacter, Span(src, 4, 1)));
+  REQUIRE(limited.size() == 1);
+  CHECK(limited.begin()->span.offset - src.base == 4);
 }
 
 /* -------------------------------------------------------------------------- */
@@ -137,7 +575,7 @@ TEST_CASE("Basic lexer tokenization") {
   Lexer lexer(src, tokens, diagnostics);
 
   lexer.lex();
-  const auto resulting_tokens = tokens.data();
+  const auto &resulting_tokens = tokens;
   CHECK(resulting_tokens.size() == 8);
   CHECK(resulting_tokens[0].kind == Token::Kind::Identifier);
   CHECK(resulting_tokens[1].kind == Token::Kind::Colon);
@@ -153,6 +591,723 @@ TEST_CASE("Basic lexer tokenization") {
   tokens.print_all();
 }
 
+TEST_CASE("Token collections keep long token lengths") {
+  const std::string longest(70000, 'x');
+  const Source src("a " + std::string(255, 'b') + " " + longest + " 1");
+
+  DiagCollect diagnostics;
+  TokenCollect tokens(src);
+  Lexer(src, tokens, diagnostics).lex();
+  REQUIRE(tokens.size() == 5);
+  CHECK(tokens[0].span.length == 1);
+  CHECK(tokens[1].span.length == 255);
+  CHECK(tokens[2].span.lexeme() == longest);
+  CHECK(tokens.kind(3) == Token::Kind::Integer);
+  CHECK(tokens[3].span.lexeme() == "1");
+
+  // Appending shifts the indices of the long tokens along with the tokens
+  TokenCollect both(src);
+  both.append(tokens);
+  both.append(tokens);
+  REQUIRE(both.size() == 10);
+  CHECK(both[6].span.length == 255);
+  CHECK(both[7].span.length == longest.size());
+  CHECK(both[8].span.length == 1);
+}
+
+TEST_CASE("Lexing non-ASCII identifiers and invalid UTF-8") {
+  {
+    const Source src("caf\xC3\xA9 := na\xC3\xAFve");
+    DiagCollect diagnostics;
+    TokenCollect tokens(src);
+    Lexer lexer(src, tokens, diagnostics);
+    lexer.lex();
+
+    const auto &resulting_tokens = tokens;
+    CHECK(resulting_tokens.size() == 5);
+    CHECK(resulting_tokens[0].kind == Token::Kind::Identifier);
+    CHECK(resulting_tokens[0].span.lexeme() == "caf\xC3\xA9");
+    CHECK(resulting_tokens[3].kind == Token::Kind::Identifier);
+    CHECK(resulting_tokens[3].span.column_number() == 9);
+    CHECK(diagnostics.size() == 0);
+  }
+  {
+    const Source src("a \xFF b");
+    DiagCollect diagnostics;
+    TokenCollect tokens(src);
+    Lexer lexer(src, tokens, diagnostics);
+    lexer.lex();
+
+    REQUIRE(diagnostics.size() == 1);
+    auto ss = sstream_new();
+    ss << *diagnostics.begin();
+    CHECK(ss.str().find("invalid UTF-8") != std::string::npos);
+    CHECK(ss.str().find("<static>:1:3") != std::string::npos);
+  }
+}
+
+TEST_CASE("Identifiers carry their interned symbols") {
+  const Source src("count = total + count if r\xC3\xA9sum\xC3\xA9 total");
+  DiagCollect diagnostics;
+  TokenCollect tokens(src);
+  Lexer(src, tokens, diagnostics).lex();
+  REQUIRE(tokens.size() == 9);
+
+  for (size_t i = 0; i < tokens.size(); ++i) {
+    const auto token = tokens[i];
+    CHECK(tokens.symbol(i) == token.symbol);
+    if (token.kind != Token::Kind::Identifier) {
+      CHECK(token.symbol == NO_SYMBOL);
+      continue;
+    }
+    CHECK(SymbolTable::global().name(token.symbol) == token.span.lexeme());
+  }
+  CHECK(tokens[0].symbol == tokens[4].symbol);
+  CHECK(tokens[2].symbol == tokens[7].symbol);
+  CHECK(tokens[0].symbol != tokens[2].symbol);
+}
+
+TEST_CASE("Keywords are recognized from KEYWORD_LIST") {
+  const std::pair<std::string, Token::Kind> keywords[] = {
+#define X(name, repr) {repr, Token::Kind::name},
+      KEYWORD_LIST
+#undef X
+  };
+
+  // Each keyword lexes as itself, while near misses stay identifiers
+  for (const auto &[repr, kind] : keywords) {
+    for (const auto &text : {repr, repr + "_", "_" + repr, repr + repr,
+                             repr.substr(1), repr.substr(0, repr.size() - 1),
+                             std::string(1, repr[0] - 32) + repr.substr(1)}) {
+      const Source src(text);
+      DiagCollect diagnostics;
+      TokenCollect tokens(src);
+      Lexer lexer(src, tokens, diagnostics);
+      lexer.lex();
+      REQUIRE(tokens.size() == 2);
+      CHECK(tokens[0].kind ==
+            (text == repr ? kind : Token::Kind::Identifier));
+    }
+  }
+}
+
+TEST_CASE("Every operator and keyword lexes to its own kind") {
+  constexpr std::pair<std::string_view, Token::Kind> TOKENS[] = {
+#define X(name, repr) {repr, Token::Kind::name},
+      TOKEN_LIST
+#undef X
+  };
+
+  // The literal and meta tokens come last, and their reprs are only names
+  std::string all;
+  std::vector<Token::Kind> expected;
+  for (const auto &[repr, kind] : TOKENS) {
+    if (kind >= Token::Kind::Identifier)
+      continue;
+    const Source src{std::string(repr)};
+    DiagCollect diagnostics;
+    TokenCollect tokens(src);
+    Lexer(src, tokens, diagnostics).lex();
+    CAPTURE(repr);
+    REQUIRE(tokens.size() == 2);
+    CHECK(tokens[0].kind == kind);
+    CHECK(tokens[0].span.lexeme() == repr);
+    CHECK(diagnostics.size() == 0);
+
+    all += std::string(repr) + " ";
+    expected.push_back(kind);
+  }
+  expected.push_back(Token::Kind::Eof);
+
+  const Source src(all);
+  DiagCollect diagnostics;
+  TokenCollect tokens(src);
+  Lexer(src, tokens, diagnostics).lex();
+  std::vector<Token::Kind> kinds;
+  for (const auto token : tokens)
+    kinds.push_back(token.kind);
+  CHECK(kinds == expected);
+
+  // The longest operator wins, however the rest of the source continues
+  const Source glued("a+++=b**==c//==d<==e&&&f");
+  TokenCollect glued_tokens(glued);
+  Lexer(glued, glued_tokens, diagnostics).lex();
+  std::string lexemes;
+  for (const auto token : glued_tokens)
+    lexemes += std::string(token.span.lexeme()) + " ";
+  CHECK(lexemes == "a ++ += b **= = c //= = d <= = e && & f  ");
+}
+
+TEST_CASE("Every byte value lexes by its character class") {
+  const std::string singles = "()[]{}.,:;?%+-*/&|<>!=";
+  for (unsigned c = 0; c < 256; ++c) {
+    const auto ch = static_cast<char>(c);
+    const Source src(std::string(1, ch));
+    DiagCollect diagnostics;
+    TokenCollect tokens(src);
+    Lexer lexer(src, tokens, diagnostics);
+    lexer.lex();
+
+    const bool whitespace =
+        ch == ' ' || ch == '\t' || ch == '\r' || ch == '\v' || ch == '\b';
+    const bool letter = (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') ||
+                        ch == '_' || c >= 0x80;
+    const bool digit = ch >= '0' && ch <= '9';
+    const bool single = c != 0 && singles.find(ch) != std::string::npos;
+
+    CHECK(scan::is_whitespace(ch) == whitespace);
+    CHECK(scan::is_ident_start(ch) == letter);
+    CHECK(scan::is_digit(ch) == digit);
+    CHECK(scan::is_string_body(ch) ==
+          (c != 0 && ch != '"' && ch != '\\' && ch != '\n'));
+    const bool token = letter || digit || single || ch == '\n';
+    const bool comment = ch == '#';
+    CHECK(tokens.size() == (token ? 2 : 1));
+    CHECK(diagnostics.size() ==
+          (token || whitespace || comment ? 0 : 1) + (c >= 0x80));
+    if (!token)
+      continue;
+
+    const auto kind = tokens[0].kind;
+    if (letter)
+      CHECK(kind == Token::Kind::Identifier);
+    else if (digit)
+      CHECK(kind == Token::Kind::Integer);
+    else if (ch == '\n')
+      CHECK(kind == Token::Kind::Newline);
+    else
+      CHECK(tokens[0].span.lexeme() == std::string(1, ch));
+  }
+}
+
+TEST_CASE("Vectorized scanners agree with the character classes") {
+  // Runs of each class broken by every byte value, at every alignment
+  std::string text;
+  for (size_t i = 0; i < 256; ++i) {
+    text += std::string(i % 40, " \t"[i % 2]);
+    text += std::string(i % 37, "0123456789"[i % 10]);
+    text += std::string(i % 45, "aZ_\xC3\xA9"[i % 5]);
+    text += std::string(i % 70, "x ({\xC3"[i % 4]);
+    text += static_cast<char>(i);
+  }
+
+  const auto reference = [&](bool (*accept)(char), size_t from) {
+    size_t end = from;
+    while (end < text.size() && accept(text[end]))
+      ++end;
+    return end - from;
+  };
+
+  // The scanners stop at the sentinel padding, like at the end of a source
+  const std::string padded = text + std::string(SOURCE_PADDING, '\0');
+  for (const auto level :
+       {simd::Level::Scalar, simd::Level::SSE2, simd::Level::AVX2}) {
+    simd::set_level(level);
+    for (size_t i = 0; i <= text.size(); ++i) {
+      const auto *data = padded.data() + i;
+      REQUIRE(scan::span_whitespace(data) ==
+              reference(scan::is_whitespace, i));
+      REQUIRE(scan::span_identifier(data) ==
+              reference(scan::is_ident_cont, i));
+      REQUIRE(scan::span_digits(data) == reference(scan::is_digit, i));
+      REQUIRE(scan::span_string(data) == reference(scan::is_string_body, i));
+      REQUIRE(scan::span_comment(data) ==
+              reference(scan::is_comment_body, i));
+    }
+  }
+  simd::set_level(simd::Level::AVX2);
+}
+
+TEST_CASE("String literals are scanned and decoded lazily") {
+  const Source src("s = \"plain\" \"a\\\"b\\\\c\\n\" \"\"\n"
+                   "\"bad \\q\" \"open\nx \"end\\\n\"");
+  DiagCollect diagnostics;
+  TokenCollect tokens(src);
+  Lexer(src, tokens, diagnostics).lex();
+
+  REQUIRE(tokens.size() == 10);
+  CHECK(tokens[2].kind == Token::Kind::String);
+  CHECK(tokens[3].kind == Token::Kind::String);
+  CHECK(tokens[4].kind == Token::Kind::String);
+  CHECK(tokens[5].kind == Token::Kind::Newline);
+  CHECK(tokens[6].kind == Token::Kind::Newline);
+  CHECK(tokens[7].kind == Token::Kind::Identifier);
+  CHECK(tokens[8].kind == Token::Kind::Newline);
+
+  // Literals without escapes are views into the source
+  std::string buffer;
+  const auto plain = decode_string(src, tokens[2], buffer);
+  CHECK(plain == "plain");
+  CHECK(plain.data() == tokens[2].span.lexeme().data() + 1);
+  CHECK(decode_string(src, tokens[3], buffer) == "a\"b\\c\n");
+  CHECK(decode_string(src, tokens[4], buffer).empty());
+
+  // An invalid escape, and literals cut off by a newline or by the end
+  std::vector<std::pair<Diagnostic::Issue, std::string>> found;
+  for (const auto &diag : diagnostics)
+    found.emplace_back(diag.issue, std::string(diag.span.lexeme()));
+  const decltype(found) expected = {
+      {Diagnostic::Issue::InvalidString, "\"bad \\q\""},
+      {Diagnostic::Issue::UnterminatedString, "\"open"},
+      {Diagnostic::Issue::UnterminatedString, "\"end\\"},
+      {Diagnostic::Issue::UnterminatedString, "\""},
+  };
+  CHECK(found == expected);
+
+  // Long literals are scanned a vector at a time, wherever they end
+  for (const auto level :
+       {simd::Level::Scalar, simd::Level::SSE2, simd::Level::AVX2}) {
+    simd::set_level(level);
+    for (const size_t length : {0, 1, 15, 16, 31, 32, 33, 1000, 100000}) {
+      const std::string blob(length, 'z');
+      const Source blobs("\"" + blob + "\" \"" + blob + "\\t\"");
+      TokenCollect blob_tokens(blobs);
+      Lexer(blobs, blob_tokens, diagnostics).lex();
+      REQUIRE(blob_tokens.size() == 3);
+      CHECK(decode_string(blobs, blob_tokens[0], buffer) == blob);
+      CHECK(decode_string(blobs, blob_tokens[1], buffer) == blob + "\t");
+    }
+  }
+  simd::set_level(simd::Level::AVX2);
+}
+
+TEST_CASE("Numeric literals are decoded without allocating") {
+  const Source src("0 7 2147483647 2147483648 000000000000000000042 "
+                   "99999999999999999999999 0.5 3.14159 0.1 "
+                   "123456789012345678.25 1" +
+                   std::string(400, '0') + ".0 0." + std::string(400, '0') +
+                   "1 00.0" + std::string(320, '0') + "1");
+  DiagCollect diagnostics;
+  TokenCollect tokens(src);
+  Lexer(src, tokens, diagnostics).lex();
+  REQUIRE(tokens.size() == 14);
+
+  CHECK(tokens[0].integer() == 0);
+  CHECK(tokens[1].integer() == 7);
+  CHECK(tokens[2].integer() == 2147483647);
+  CHECK(tokens[4].integer() == 42);
+
+  // Integers and decimals too large are reported by the lexer
+  std::vector<uint32_t> overflowed;
+  for (const auto &diag : diagnostics) {
+    CHECK(diag.issue == Diagnostic::Issue::LiteralOverflow);
+    overflowed.push_back(diag.span.offset);
+  }
+  CHECK(overflowed == std::vector<uint32_t>{tokens[3].span.offset,
+                                            tokens[5].span.offset,
+                                            tokens[10].span.offset});
+
+  // Decimals are correctly rounded, agreeing with the reference conversion
+  for (size_t i = 6; i < 10; ++i) {
+    const std::string lexeme(tokens[i].span.lexeme());
+    CHECK(decode_decimal(src, tokens[i]) ==
+          std::strtod(lexeme.c_str(), nullptr));
+  }
+  CHECK_FALSE(decode_decimal(src, tokens[10]).has_value());
+
+  // Literals too small for a double round to zero, or to a subnormal
+  CHECK(decode_decimal(src, tokens[11]) == 0.0);
+  const std::string subnormal(tokens[12].span.lexeme());
+  CHECK(decode_decimal(src, tokens[12]) ==
+        std::strtod(subnormal.c_str(), nullptr));
+  CHECK(decode_decimal(src, tokens[12]) > 0.0);
+}
+
+TEST_CASE("Comments are skipped or kept as trivia") {
+  const Source src("a # line // comment\n"
+                   "b /* block /* nested */ still */ c // d\n"
+                   "/* never closed /* */");
+
+  DiagCollect diagnostics;
+  TokenCollect tokens(src);
+  Lexer(src, tokens, diagnostics).lex();
+  DiagCollect trivia_diagnostics;
+  TokenCollect trivia(src, true);
+  Lexer(src, trivia, trivia_diagnostics).lex();
+
+  // Keeping trivia doesn't change the tokens
+  using enum Token::Kind;
+  const std::vector<Token::Kind> expected = {
+      Identifier, Newline, Identifier, Identifier, SlashSlash,
+      Identifier, Newline, Eof};
+  std::vector<Token::Kind> kinds, trivia_kinds;
+  for (const auto token : tokens)
+    kinds.push_back(token.kind);
+  for (const auto token : trivia)
+    trivia_kinds.push_back(token.kind);
+  CHECK(kinds == expected);
+  CHECK(trivia_kinds == expected);
+
+  // Comments belong to the token after them
+  CHECK(tokens.trivia(1).empty());
+  REQUIRE(trivia.trivia(1).size() == 1);
+  CHECK(trivia.trivia(1)[0].lexeme() == "# line // comment");
+  REQUIRE(trivia.trivia(3).size() == 1);
+  CHECK(trivia.trivia(3)[0].lexeme() == "/* block /* nested */ still */");
+  REQUIRE(trivia.trivia(7).size() == 1);
+  CHECK(trivia.trivia(7)[0].lexeme() == "/* never closed /* */");
+
+  REQUIRE(diagnostics.size() == 1);
+  const auto &diag = *diagnostics.begin();
+  CHECK(diag.issue == Diagnostic::Issue::UnterminatedComment);
+  CHECK(diag.span.lexeme() == "/* never closed /* */");
+}
+
+TEST_CASE("Lexing stops at the error limit") {
+  std::string garbage;
+  for (size_t i = 0; i < 10000; ++i)
+    garbage += "$ ";
+  const Source src(garbage);
+
+  DiagCollect diagnostics(3);
+  TokenCollect tokens(src);
+  Lexer lexer(src, tokens, diagnostics);
+  lexer.lex();
+  CHECK(diagnostics.error_count() == 3);
+  CHECK(diagnostics.size() == 3);
+  REQUIRE(tokens.size() == 1);
+  CHECK(tokens.eof().kind == Token::Kind::Eof);
+
+  // A contiguous run is a single error, so it doesn't use up the limit
+  const Source run(std::string(10000, '$') + " 1");
+  DiagCollect run_diagnostics(3);
+  TokenCollect run_tokens(run);
+  Lexer run_lexer(run, run_tokens, run_diagnostics);
+  run_lexer.lex();
+  CHECK(run_diagnostics.size() == 1);
+  CHECK(run_tokens.size() == 2);
+}
+
+TEST_CASE("Parallel lexing matches sequential lexing") {
+  std::string text;
+  for (size_t i = 0; i < 200; ++i)
+    text += "x" + std::to_string(i) + " := function(a, b) a ** b //= 3.25\n" +
+            (i % 7 == 0 ? "  $$ r\xC3\xA9sum\xC3\xA9 $ 12.x\n" : "\n") +
+            (i % 5 == 0 ? "s = \"a\\\"b $\" \"open\n" : "") +
+            (i % 3 == 0 ? "/* spans\n lines /* and\n nests */\n */ # $\n"
+                        : "") +
+            "for x <= 100 { x++ } **= 1234567\n";
+  const Source src(text);
+
+  // Renders everything that was lexed, to compare both ways of lexing
+  const auto lexed = [&](size_t error_limit, ThreadPool *pool, size_t chunk) {
+    DiagCollect diagnostics(error_limit);
+    TokenCollect tokens(src);
+    Lexer lexer(src, tokens, diagnostics);
+    if (pool != nullptr)
+      lexer.lex(*pool, chunk);
+    else
+      lexer.lex();
+
+    auto ss = sstream_new();
+    for (const auto token : tokens)
+      ss << token << " " << token.span.offset << "+" << token.span.length
+         << " " << token.symbol << "\n";
+    diagnostics.print_all(ss);
+    return ss.str();
+  };
+
+  ThreadPool pool(4);
+  for (const size_t error_limit : {0, 1, 5, 20}) {
+    const auto expected = lexed(error_limit, nullptr, 0);
+    for (const size_t chunk : {1, 13, 100, 4096})
+      CHECK(lexed(error_limit, &pool, chunk) == expected);
+  }
+}
+
+TEST_CASE("Pipelined lexing publishes every token through the ring") {
+  std::string text;
+  for (size_t i = 0; text.size() < 8 * TOKEN_BATCH_BYTES; ++i)
+    text += "x" + std::to_string(i) + " := function(a, b) a ** b //= 3.25\n" +
+            (i % 7 == 0 ? "  $ 12.x\n" : "\n");
+  const Source src(text);
+
+  DiagCollect expected_diagnostics;
+  TokenCollect expected(src);
+  Lexer(src, expected, expected_diagnostics).lex();
+
+  // A ring of two batches keeps the lexer waiting on the consumer
+  DiagCollect diagnostics;
+  TokenRing ring(2);
+  std::thread lexing([&] {
+    TokenCollect batch(src);
+    Lexer(src, batch, diagnostics).lex(ring);
+  });
+  size_t mismatches = 0;
+  for (size_t i = 0; i < expected.size(); ++i) {
+    const auto token = ring.at(i);
+    const auto want = expected[i];
+    mismatches += token.kind != want.kind ||
+                  token.span.offset != want.span.offset ||
+                  token.span.length != want.span.length;
+    ring.release(i);
+  }
+  CHECK(mismatches == 0);
+  CHECK(ring.at(expected.size() + 5).kind == Token::Kind::Eof);
+  lexing.join();
+  CHECK(diagnostics.size() == expected_diagnostics.size());
+
+  // A consumer that stops early drains the ring so the lexer can finish
+  TokenRing early(2);
+  std::thread draining([&] {
+    DiagCollect ignored;
+    TokenCollect batch(src);
+    Lexer(src, batch, ignored).lex(early);
+  });
+  CHECK(early.at(3).kind == expected[3].kind);
+  early.drain();
+  draining.join();
+
+  // The parser releases batches as it goes, so the lexer finishes without
+  // the ring being drained
+  TokenRing parsed(2);
+  std::thread parsing([&] {
+    TokenCollect batch(src);
+    Lexer(src, batch, diagnostics).lex(parsed);
+  });
+  Parser(src, parsed, diagnostics).parse();
+  parsing.join();
+}
+
+TEST_CASE("Incremental re-lexing matches lexing the edited source") {
+  std::string text;
+  for (size_t i = 0; i < 300; ++i)
+    text += "x" + std::to_string(i) + " := function(a, b) a ** b //= 3.25\n" +
+            (i % 7 == 0 ? "  r\xC3\xA9sum\xC3\xA9 $ 12.x\n" : "\n") +
+            (i % 5 == 0 ? "s = \"a\\\\b\" \"open\n" : "") +
+            (i % 9 == 0 ? "/* a /* nested */ comment */ # note\n" : "");
+
+  // Renders tokens and the comments in front of them by their position within
+  // their source
+  const auto render = [](const Source &src, const TokenCollect &tokens) {
+    auto ss = sstream_new();
+    for (size_t i = 0; i < tokens.size(); ++i) {
+      for (const auto &comment : tokens.trivia(i))
+        ss << "# " << comment.offset - src.base << "+" << comment.length
+           << "\n";
+      ss << static_cast<int>(tokens[i].kind) << " "
+         << tokens[i].span.offset - src.base << "+" << tokens[i].span.length
+         << "\n";
+    }
+    return ss.str();
+  };
+
+  auto src = std::make_unique<Source>(text);
+  DiagCollect ignored;
+  TokenCollect tokens(*src, true);
+  Lexer(*src, tokens, ignored).lex();
+
+  const std::string insertions[] = {"",  "y",   " ",     "*",      "=",
+                                    "\n", "12.5", "$",     "fun",    "+= 7 ",
+                                    "#", "\"",   "\\",    "\xC3\xA9", "/*",
+                                    "*/"};
+  std::mt19937 rng(3);
+  for (size_t i = 0; i < 300; ++i) {
+    const size_t offset = rng() % (text.size() + 1);
+    const SourceEdit edit{
+        .offset = offset,
+        .removed = std::min<size_t>(rng() % 4, text.size() - offset),
+        .inserted = insertions[rng() % std::size(insertions)],
+    };
+    text.replace(edit.offset, edit.removed, edit.inserted);
+
+    // The old source goes away once the tokens have been patched
+    auto edited = std::make_unique<Source>(text);
+    DiagCollect diagnostics;
+    Lexer lexer(*edited, tokens, diagnostics);
+    lexer.relex(edit);
+    src = std::move(edited);
+
+    TokenCollect expected(*src, true);
+    Lexer(*src, expected, ignored).lex();
+    REQUIRE(render(*src, tokens) == render(*src, expected));
+  }
+
+  // Typing into an identifier only lexes that identifier again
+  const Source before("alpha := beta + gamma\n" + std::string(10000, ';'));
+  const Source after("alpha := betta + gamma\n" + std::string(10000, ';'));
+  TokenCollect typed(before);
+  Lexer(before, typed, ignored).lex();
+  CHECK(Lexer(after, typed, ignored).relex({11, 0, "t"}) == 1);
+}
+
+TEST_CASE("Streaming lexer matches whole-source lexing") {
+  const std::string text = "main := function(a, b) a ** b //= 3.25\n"
+                           "  r\xC3\xA9sum\xC3\xA9 $ 12.x != 7\n"
+                           "s = \"long \\\"quoted\\\" text\" \"open\n"
+                           "/* a /* nested\n */ comment */ # and a line one\n"
+                           "for x <= 100 { x++ } **= 1234567";
+
+  // The reference: the same text lexed in one go
+  struct Lexed {
+    Token::Kind kind;
+    std::string lexeme;
+    uint64_t offset, line, column;
+    bool operator==(const Lexed &) const = default;
+  };
+  std::vector<Lexed> expected;
+  std::vector<uint64_t> expected_diagnostics;
+  {
+    const Source src(text);
+    DiagCollect diagnostics;
+    TokenCollect tokens(src);
+    Lexer lexer(src, tokens, diagnostics);
+    lexer.lex();
+    for (const auto token : tokens) {
+      const auto offset = token.span.offset - src.base;
+      expected.push_back({token.kind, std::string(token.span.lexeme()), offset,
+                          src.line_of(offset), src.column_of(offset)});
+    }
+    for (const auto &diag : diagnostics)
+      expected_diagnostics.push_back(diag.span.offset - src.base);
+  }
+
+  for (size_t chunk = 1; chunk <= text.size(); ++chunk) {
+    std::vector<Lexed> streamed;
+    std::vector<uint64_t> streamed_diagnostics;
+    StreamLexer lexer(
+        "<stream>",
+        [&](const Token &token, const StreamPosition &at) {
+          streamed.push_back({token.kind, std::string(token.span.lexeme()),
+                              at.offset, at.line, at.column});
+        },
+        [&](const Diagnostic &, const StreamPosition &at) {
+          streamed_diagnostics.push_back(at.offset);
+        });
+
+    for (size_t i = 0; i < text.size(); i += chunk)
+      lexer.feed(std::string_view(text).substr(i, chunk));
+    lexer.finish();
+
+    CHECK(streamed == expected);
+    CHECK(streamed_diagnostics == expected_diagnostics);
+  }
+}
+
+TEST_CASE("Streaming lexer reports diagnostics like whole-source lexing") {
+  // Invalid UTF-8 is reported once per stream, and runs of errors are
+  // coalesced across windows
+  for (const std::string text :
+       {"\x90\"\xFF", "\"\\c\"\"\\s\"", "$$$$$$$$ x $$"}) {
+    const Source src(text);
+    DiagCollect diagnostics;
+    TokenCollect tokens(src);
+    Lexer(src, tokens, diagnostics).lex();
+    std::vector<std::pair<Diagnostic::Issue, uint64_t>> expected;
+    for (const auto &diag : diagnostics)
+      expected.emplace_back(diag.issue, diag.span.offset - src.base);
+
+    for (size_t chunk = 1; chunk <= text.size(); ++chunk) {
+      std::vector<std::pair<Diagnostic::Issue, uint64_t>> streamed;
+      StreamLexer lexer(
+          "<stream>", [](const Token &, const StreamPosition &) {},
+          [&](const Diagnostic &diag, const StreamPosition &at) {
+            streamed.emplace_back(diag.issue, at.offset);
+          });
+      for (size_t i = 0; i < text.size(); i += chunk)
+        lexer.feed(std::string_view(text).substr(i, chunk));
+      lexer.finish();
+      CHECK(streamed == expected);
+    }
+  }
+}
+
+TEST_CASE("Streaming lexer carries bounded runs of errors") {
+  // A run of invalid bytes longer than `MAX_CARRIED_RUN` is handed out in
+  // pieces rather than carried, and lexed again, with every chunk
+  constexpr size_t CHUNK = 16 * 1024;
+  const std::string text(4 * 1024 * 1024, '$');
+  std::vector<std::pair<uint64_t, uint32_t>> runs;
+  size_t eof = 0;
+  StreamLexer lexer(
+      "<stream>",
+      [&](const Token &token, const StreamPosition &at) {
+        CHECK(token.kind == Token::Kind::Eof);
+        eof = at.offset;
+      },
+      [&](const Diagnostic &diag, const StreamPosition &at) {
+        CHECK(diag.issue == Diagnostic::Issue::InvalidCharacter);
+        runs.emplace_back(at.offset, diag.span.length);
+      });
+  for (size_t i = 0; i < text.size(); i += CHUNK)
+    lexer.feed(std::string_view(text).substr(i, CHUNK));
+  lexer.finish();
+
+  REQUIRE(runs.size() > 1);
+  uint64_t next = 0;
+  for (const auto &[offset, length] : runs) {
+    CHECK(offset == next);
+    CHECK(length <= MAX_CARRIED_RUN + CHUNK);
+    next = offset + length;
+  }
+  CHECK(next == text.size());
+  CHECK(eof == text.size());
+}
+
+TEST_CASE("Streaming lexer stops at the error limit") {
+  // Invalid UTF-8 is reported once, and only counted once towards the limit
+  for (const std::string text :
+       {"a $ b\n$ c $ d\n\"x", "\xFF $ \xFE $ $ x"}) {
+    std::vector<std::pair<Token::Kind, uint64_t>> expected;
+    std::vector<uint64_t> expected_diagnostics;
+    {
+      const Source src(text);
+      DiagCollect diagnostics(4);
+      TokenCollect tokens(src);
+      Lexer(src, tokens, diagnostics).lex();
+      for (const auto token : tokens)
+        expected.emplace_back(token.kind, token.span.offset - src.base);
+      for (const auto &diag : diagnostics)
+        expected_diagnostics.push_back(diag.span.offset - src.base);
+    }
+    REQUIRE(expected_diagnostics.size() == 4);
+
+    for (size_t chunk = 1; chunk <= text.size(); ++chunk) {
+      std::vector<std::pair<Token::Kind, uint64_t>> streamed;
+      std::vector<uint64_t> streamed_diagnostics;
+      StreamLexer lexer(
+          "<stream>",
+          [&](const Token &token, const StreamPosition &at) {
+            streamed.emplace_back(token.kind, at.offset);
+          },
+          [&](const Diagnostic &, const StreamPosition &at) {
+            streamed_diagnostics.push_back(at.offset);
+          },
+          4);
+      for (size_t i = 0; i < text.size(); i += chunk)
+        lexer.feed(std::string_view(text).substr(i, chunk));
+      lexer.finish();
+
+      CHECK(streamed == expected);
+      CHECK(streamed_diagnostics == expected_diagnostics);
+    }
+  }
+}
+
+TEST_CASE("Streaming lexer reads from a pipe") {
+  int fds[2];
+  REQUIRE(pipe(fds) == 0);
+  const std::string text = "if x == 1 {\n  break\n}\n";
+  REQUIRE(write(fds[1], text.data(), text.size()) ==
+          static_cast<ssize_t>(text.size()));
+  close(fds[1]);
+
+  StreamSource stream(fds[0], "<pipe>", 5);
+  std::vector<Token::Kind> kinds;
+  StreamLexer lexer(
+      stream.path,
+      [&](const Token &token, const StreamPosition &) {
+        kinds.push_back(token.kind);
+      },
+      [&](const Diagnostic &, const StreamPosition &) { CHECK(false); });
+  CHECK(lexer.lex(stream).has_value());
+  close(fds[0]);
+
+  using enum Token::Kind;
+  CHECK(kinds == std::vector{If, Identifier, EqualEqual, Integer, LCurl,
+                             Newline, Break, Newline, RCurl, Newline, Eof});
+}
+
 /* -------------------------------------------------------------------------- */
 /* COMMON/OPERATOR */
 /* -------------------------------------------------------------------------- */
@@ -215,4 +1370,39 @@ TEST_CASE(
     CHECK(r.value().kind == ast::Kind::Float);
     r.value().print(0);
   }
-}
\ No newline at end of file
+}
+
+TEST_CASE("Out of range literals are reported by the lexer") {
+  for (const auto &[text, literal] :
+       {std::pair{std::string("x = 99999999999999999999"),
+                  std::string("99999999999999999999")},
+        std::pair{std::string("2147483648"), std::string("2147483648")},
+        std::pair{"y = 1" + std::string(400, '0') + ".5",
+                  "1" + std::string(400, '0') + ".5"}}) {
+    const Source src(text);
+    DiagCollect diagnostics;
+    TokenCollect tokens(src);
+    Lexer(src, tokens, diagnostics).lex();
+
+    // Reported while lexing, before the parser ever sees the literal
+    REQUIRE(diagnostics.size() == 1);
+    const auto &diag = *diagnostics.begin();
+    CHECK(diag.issue == Diagnostic::Issue::LiteralOverflow);
+    CHECK(diag.span.lexeme() == literal);
+
+    // And not reported again by the parser
+    Parser(src, tokens, diagnostics).parse();
+    CHECK(diagnostics.size() == 1);
+  }
+
+  // A literal too small for a double isn't reported, it rounds to zero
+  const Source tiny("0." + std::string(400, '0') + "1");
+  DiagCollect diagnostics;
+  TokenCollect tokens(tiny);
+  Lexer(tiny, tokens, diagnostics).lex();
+  const auto node = Parser(tiny, tokens, diagnostics).parse_expr();
+  REQUIRE(node.has_value());
+  CHECK(node->kind == ast::Kind::Float);
+  CHECK(node->data.node_float.value == 0.0);
+  CHECK(diagnostics.size() == 0);
+}